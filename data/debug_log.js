@@ -1,12 +1,24 @@
 var url = 'ws://' + location.hostname + ':81/';
 var log_enabled = false;
 
+// Levels of logs can be changed separately for every module of ESP
+var log_modules = ["system", "web", "ws", "arduino", "stk500", "fs"];
+var log_levels = ["error", "warning", "info", "debug", "trace"];
+var log_levels_prefix = "LOG LEVELS: ";
+// Replies to log levels requests come in correlation envelope "#<request_id> ", so they are not mixed with logs
+var log_levels_request_id = 0;
+var next_request_id = 1;
+// Search results come in the same envelope with ID of search request. Search ends with "DONE: N records found"
+var search_request_id = 0;
+var search_done_prefix = "DONE: ";
+
 // Send data as binary, NOT as text. If Arduino or ESP will log some special (non printable) character,
 // it will ruin text-based web-socket, but binary-based web-sockets handle it well.
 var connection = new WebSocket(url, ['arduino']);
 connection.binaryType = "arraybuffer";
 
 connection.onopen = function () {
+  send_log_levels_request("get_log_levels");
 };
 
 connection.onerror = function (error) {
@@ -16,7 +28,20 @@ connection.onerror = function (error) {
 connection.onmessage = function (message) {
   var log_view = document.getElementById("debug_log");
   //log_view.innerHTML += message.data;  // For text-based web-socket
-  log_view.innerText += new TextDecoder().decode(message.data);  // For binary-based web-socket
+  split_ws_frame(message.data).forEach(function (data) {
+    var text = new TextDecoder().decode(data);  // For binary-based web-socket
+    var envelope = "#" + log_levels_request_id + " ";
+    if (log_levels_request_id != 0 && text.startsWith(envelope)) {
+      handle_log_levels_reply(text.substring(envelope.length));
+      return;
+    }
+    envelope = "#" + search_request_id + " ";
+    if (search_request_id != 0 && text.startsWith(envelope)) {
+      handle_search_reply(text.substring(envelope.length));
+      return;
+    }
+    log_view.innerText += text;
+  });
   log_view.scrollTop = log_view.scrollHeight;  // Auto-scroll
 };
 
@@ -33,8 +58,40 @@ function toggle_reading_logs() {
   } else {
     log_enabled = true;
     document.getElementById("reading_logs_button").textContent = "Stop reading logs";
-    connection.send("start_reading_logs");
+    // ESP replays all retained history, which matches the filter
+    document.getElementById("debug_log").innerText = "";
+    connection.send("start_reading_logs " + get_log_query());
+  }
+}
+
+// Build log query from filter controls: "level=<level> [modules=<module>,...] [text=<substring>]"
+function get_log_query() {
+  var query = "level=" + document.getElementById("filter_level").value;
+  var modules = document.getElementById("filter_modules").value.replace(/\s+/g, "");
+  if (modules.length != 0) {
+    query += " modules=" + modules;
+  }
+  // Substring should be the last parameter, because it can contain spaces
+  var text = document.getElementById("filter_text").value;
+  if (text.length != 0) {
+    query += " text=" + text;
+  }
+  return query;
+}
+
+function search_logs() {
+  document.getElementById("search_results").innerText = "";
+  search_request_id = next_request_id++;
+  connection.send("#" + search_request_id + " search_logs " + get_log_query());
+}
+
+function handle_search_reply(reply) {
+  var results = document.getElementById("search_results");
+  if (reply.startsWith(search_done_prefix) || reply.startsWith("ERROR") || reply.startsWith("BUSY")) {
+    results.innerText += "\n" + reply + "\n";
+    return;
   }
+  results.innerText += reply;
 }
 
 function send_arduino_command() {
@@ -46,3 +103,44 @@ function send_arduino_command() {
   connection.send("arduino_command " + message);
   document.getElementById("arduino_command").value = "";
 }
+
+function create_log_levels_controls() {
+  var container = document.getElementById("log_levels");
+  log_modules.forEach(function (module) {
+    var label = document.createElement("label");
+    label.textContent = module + ": ";
+    var select = document.createElement("select");
+    select.id = "log_level_" + module;
+    log_levels.forEach(function (level) {
+      var option = document.createElement("option");
+      option.value = level;
+      option.textContent = level;
+      select.appendChild(option);
+    });
+    select.onchange = function () {
+      send_log_levels_request("set_log_levels " + module + "=" + select.value);
+    };
+    label.appendChild(select);
+    container.appendChild(label);
+  });
+}
+
+function send_log_levels_request(command) {
+  log_levels_request_id = next_request_id++;
+  connection.send("#" + log_levels_request_id + " " + command);
+}
+
+function handle_log_levels_reply(reply) {
+  if (!reply.startsWith(log_levels_prefix)) {
+    console.log("Failed to change log levels: " + reply);
+    return;
+  }
+
+  reply.substring(log_levels_prefix.length).split(" ").forEach(function (pair) {
+    var parts = pair.split("=");
+    var select = document.getElementById("log_level_" + parts[0]);
+    if (select) {
+      select.value = parts[1];
+    }
+  });
+}
@@ -1,4 +1,5 @@
-var url = 'ws://' + location.hostname + ':81/';
+// "/binary" URL selects compact binary encoding of settings channel (see settings_codec.js)
+var url = 'ws://' + location.hostname + ':81/binary';
 var alarm_enabled = false;
 
 // Send data as binary, NOT as text. If Arduino or ESP will log some special (non printable) character,
@@ -18,42 +19,37 @@ connection.onclose = function () {
 };
 
 connection.onmessage = function (message) {
-  // Dispatch incomming responses based on current command
-  var response = new TextDecoder().decode(message.data);
-  switch (command_in_progress) {
-    case upload_arduino_firmware_cmd:
-      handle_upload_arduino_firmware_response(response);
-      break;
-    case reboot_arduino_cmd:
-      handle_reboot_arduino_response(response);
-      break;
-    case get_arduino_settings_cmd:
-      handle_get_arduino_settings_response(response);
-      break;
-    case set_arduino_datetime_cmd:
-      handle_set_arduino_datetime_response(response);
-      break;
-    case enable_arduino_alarm_cmd:
-      handle_enable_arduino_alarm_response(response);
-      break;
-    case set_arduino_alarm_time_cmd:
-      handle_set_arduino_alarm_time_response(response);
-      break;
-    case set_arduino_sunrise_duration_cmd:
-      handle_set_arduino_sunrise_duration_response(response);
-      break;
-    case set_arduino_brightness_cmd:
-      handle_set_arduino_brightness_response(response);
-      break;
-    default:
-      console.log("ERROR: unknownd response: " + response);
-      break;
-  }
+  split_ws_frame(message.data).forEach(handle_response);
 };
 
+function handle_response(data) {
+  // Dispatch incomming responses based on request ID. All responses come in binary frames: status frames or settings
+  var frame = decode_settings_frame(data);
+  if (frame === null) {
+    console.log("ERROR: unknown response: " + new TextDecoder().decode(data));
+    return;
+  }
+
+  var request = pending_requests[frame.request_id];
+  if (request === undefined) {
+    console.log("ERROR: response to unknown request " + frame.request_id);
+    return;
+  }
+
+  // Handler returns true when it receives the last response to the request
+  if (request.handler(frame)) {
+    delete pending_requests[frame.request_id];
+  }
+}
+
 var uploaded_file_size = 0;
+var esp_firmware_upload_in_progress = false;
+
+// Requests, sent to ESP, which are still waiting for response. Several different commands can be in progress at the
+// same time, but the same command can not be sent again until previous one is finished
+var next_request_id = 1;
+var pending_requests = {};
 
-var command_in_progress = "";
 var upload_esp_firmware_cmd = "upload_esp_firmware";
 var upload_arduino_firmware_cmd = "upload_arduino_firmware";
 var reboot_arduino_cmd = "reboot_arduino";
@@ -64,112 +60,313 @@ var set_arduino_alarm_time_cmd = "set_arduino_alarm_time";
 var set_arduino_sunrise_duration_cmd = "set_arduino_sunrise_duration";
 var set_arduino_brightness_cmd = "set_arduino_brightness";
 
+function is_command_in_progress(command) {
+  for (var request_id in pending_requests) {
+    if (pending_requests[request_id].command == command) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns ID of new request or 0 if the same command is still in progress
+function start_request(command, handler) {
+  if (is_command_in_progress(command)) {
+    alert("ERROR: command \"" + command + "\" is still in progress");
+    return 0;
+  }
+
+  var request_id = next_request_id++;
+  pending_requests[request_id] = { command: command, handler: handler };
+  return request_id;
+}
+
+// Send text command in correlation envelope "#<request_id> <command>". Returns false if the same command is still in
+// progress
+function send_command(command, parameters, handler) {
+  var request_id = start_request(command, handler);
+  if (request_id == 0) {
+    return false;
+  }
+  connection.send("#" + request_id + " " + command + ((parameters.length != 0) ? " " + parameters : ""));
+  return true;
+}
+
+// Send settings command as binary frame. Returns false if the same command is still in progress
+function send_settings_command(command, frame_type, payload, handler) {
+  var request_id = start_request(command, handler);
+  if (request_id == 0) {
+    return false;
+  }
+  connection.send(encode_settings_command(frame_type, request_id, payload));
+  return true;
+}
+
 function _(element) {
   return document.getElementById(element);
 }
 
+// ESP firmware is uploaded in chunks. If connection is dropped, upload continues from the last byte, committed by ESP
+var esp_firmware_chunk_size = 16 * 1024;
+var esp_firmware_max_retries = 5;
+
 function upload_esp_file() {
   if (_("uploaded_file_name").value.length == 0) {
     // User pressed Cancel
     return;
   }
 
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
+  if (esp_firmware_upload_in_progress) {
+    alert("ERROR: command \"" + upload_esp_firmware_cmd + "\" is still in progress");
     _("uploaded_file_name").value = "";
     return;
   }
-  command_in_progress = upload_esp_firmware_cmd;
+  esp_firmware_upload_in_progress = true;
 
   var file = _("uploaded_file_name").files[0];
   uploaded_file_size = file.size;
-  // alert(file.name+" | "+file.size+" | "+file.type);
-  var formdata = new FormData();
-  formdata.append("uploaded_file", file);
+  _("upload_status").style.color = "black";
+  _("upload_status").innerHTML = "Checking file...";
+
+  read_inflated_size(file, function (image_size) {
+    calculate_md5(file, function (md5) {
+      calculate_sha256(file, function (sha256) {
+        begin_esp_upload(file, image_size, md5, sha256);
+      });
+    });
+  });
+}
 
+function begin_esp_upload(file, image_size, md5, sha256) {
+  // If the same image is already being uploaded, ESP continues previous upload
   var ajax = new XMLHttpRequest();
-  ajax.upload.addEventListener("progress", upload_progress_handler, false);
-  ajax.addEventListener("load", upload_complete_handler, false);
-  ajax.addEventListener("error", upload_error_handler, false);
-  ajax.addEventListener("abort", upload_abort_handler, false);
-  ajax.open("POST", "/update?file_size=" + uploaded_file_size);
-  ajax.send(formdata);
+  ajax.addEventListener("load", function () {
+    if (ajax.status != 200) {
+      finish_esp_upload(ajax.responseText, false);
+      return;
+    }
+    upload_esp_chunk(file, JSON.parse(ajax.responseText).offset, 0);
+  }, false);
+  ajax.addEventListener("error", function () { finish_esp_upload("Upload Failed!", false); }, false);
+  ajax.open("POST",
+            "/ota/begin?size=" + file.size + "&image_size=" + image_size + "&md5=" + md5 + "&sha256=" + sha256);
+  ajax.send();
+}
+
+// Firmware, compressed with gzip ("gzip -9 sketch.bin"), is uploaded as is and inflated by ESP on reboot. Size of
+// inflated image is taken from gzip trailer, so ESP can check that it fits into flash. 0 for not compressed image
+function read_inflated_size(file, callback) {
+  file.slice(0, 2).arrayBuffer().then(function (header) {
+    var magic = new Uint8Array(header);
+    if ((file.size < 18) || (magic[0] != 0x1f) || (magic[1] != 0x8b)) {
+      callback(0);
+      return;
+    }
+    file.slice(file.size - 4).arrayBuffer().then(function (trailer) {
+      callback(new DataView(trailer).getUint32(0, true));
+    });
+  }).catch(function () {
+    callback(0);
+  });
+}
+
+// MD5 identifies image, so ESP continues interrupted upload only with the same image. ESP also checks it by itself.
+// Web Crypto API doesn't support MD5, so it is calculated here
+function calculate_md5(file, callback) {
+  file.arrayBuffer().then(function (buffer) {
+    callback(md5(new Uint8Array(buffer)));
+  }).catch(function () {
+    callback("");
+  });
+}
+
+var md5_shifts = [7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21];
+var md5_constants = Array.from({ length: 64 }, function (value, index) {
+  return (Math.abs(Math.sin(index + 1)) * 0x100000000) >>> 0;
+});
+
+// MD5 of array of bytes (RFC 1321) as hex string
+function md5(bytes) {
+  // Message is padded with 0x80, zeros and its length in bits, so its length is multiple of 64 bytes
+  var padded_size = (((bytes.length + 8) >> 6) + 1) << 6;
+  var message = new Uint8Array(padded_size);
+  message.set(bytes);
+  message[bytes.length] = 0x80;
+  var view = new DataView(message.buffer);
+  view.setUint32(padded_size - 8, (bytes.length << 3) >>> 0, true);
+  view.setUint32(padded_size - 4, Math.floor(bytes.length / 0x20000000), true);
+
+  var state = [0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476];
+  var words = new Array(16);
+  for (var block = 0; block < padded_size; block += 64) {
+    for (var j = 0; j < 16; ++j) {
+      words[j] = view.getUint32(block + j * 4, true);
+    }
+    var a = state[0], b = state[1], c = state[2], d = state[3];
+    for (var k = 0; k < 64; ++k) {
+      var f, g;
+      if (k < 16) {
+        f = (b & c) | (~b & d);
+        g = k;
+      } else if (k < 32) {
+        f = (d & b) | (~d & c);
+        g = (5 * k + 1) % 16;
+      } else if (k < 48) {
+        f = b ^ c ^ d;
+        g = (3 * k + 5) % 16;
+      } else {
+        f = c ^ (b | ~d);
+        g = (7 * k) % 16;
+      }
+      var sum = (a + f + md5_constants[k] + words[g]) | 0;
+      var shift = md5_shifts[(k >> 4) * 4 + (k % 4)];
+      a = d;
+      d = c;
+      c = b;
+      b = (b + ((sum << shift) | (sum >>> (32 - shift)))) | 0;
+    }
+    state[0] = (state[0] + a) | 0;
+    state[1] = (state[1] + b) | 0;
+    state[2] = (state[2] + c) | 0;
+    state[3] = (state[3] + d) | 0;
+  }
 
-  _("upload_status").style.color = "black";
+  var hex = "";
+  var digest = new DataView(new ArrayBuffer(16));
+  state.forEach(function (word, index) {
+    digest.setUint32(index * 4, word >>> 0, true);
+  });
+  for (var n = 0; n < 16; ++n) {
+    hex += ("0" + digest.getUint8(n).toString(16)).slice(-2);
+  }
+  return hex;
 }
 
-function upload_progress_handler(event) {
-  // event.total contains size of uploaded file + some other data. Adjust it to display only file size.
-  var extra_data_size = event.total - uploaded_file_size;
-  var loaded = event.loaded - extra_data_size;
-  if (loaded < 0) loaded = 0;
+// Web Crypto API is available only in secure context (HTTPS or localhost). Without it image is checked by ESP only
+function calculate_sha256(file, callback) {
+  if (!window.crypto || !window.crypto.subtle) {
+    callback("");
+    return;
+  }
+  file.arrayBuffer().then(function (buffer) {
+    return window.crypto.subtle.digest("SHA-256", buffer);
+  }).then(function (digest) {
+    var hex = "";
+    new Uint8Array(digest).forEach(function (byte) {
+      hex += ("0" + byte.toString(16)).slice(-2);
+    });
+    callback(hex);
+  }).catch(function () {
+    callback("");
+  });
+}
+
+function upload_esp_chunk(file, offset, retries) {
+  if (retries > esp_firmware_max_retries) {
+    finish_esp_upload("Upload Failed!", false);
+    return;
+  }
+  show_esp_upload_progress(offset);
 
-  _("uploaded_size").innerHTML = "Uploaded " + loaded + " bytes of " + uploaded_file_size;
-  var percent = (loaded / uploaded_file_size) * 100;
+  var ajax = new XMLHttpRequest();
+  ajax.addEventListener("load", function () {
+    // 409 means that ESP expects data from another offset
+    if ((ajax.status != 200) && (ajax.status != 409)) {
+      finish_esp_upload(ajax.responseText, false);
+      return;
+    }
+    handle_esp_upload_status(file, JSON.parse(ajax.responseText), (ajax.status == 200) ? 0 : retries + 1);
+  }, false);
+  ajax.addEventListener("error", function () { resume_esp_upload(file, retries + 1); }, false);
+  ajax.open("POST", "/ota/chunk?offset=" + offset);
+  ajax.setRequestHeader("Content-Type", "application/octet-stream");
+  ajax.send(file.slice(offset, offset + esp_firmware_chunk_size));
+}
+
+// Connection is dropped. Ask ESP, which part of image is already committed, and continue from there
+function resume_esp_upload(file, retries) {
+  if (retries > esp_firmware_max_retries) {
+    finish_esp_upload("Upload Failed!", false);
+    return;
+  }
+  setTimeout(function () {
+    var ajax = new XMLHttpRequest();
+    ajax.addEventListener("load", function () {
+      handle_esp_upload_status(file, JSON.parse(ajax.responseText), retries);
+    }, false);
+    ajax.addEventListener("error", function () { resume_esp_upload(file, retries + 1); }, false);
+    ajax.open("GET", "/ota");
+    ajax.send();
+  }, 1000);
+}
+
+function handle_esp_upload_status(file, status, retries) {
+  if (status.state == "completed") {
+    show_esp_upload_progress(status.size);
+    finish_esp_upload("ESP firmware update completed! Rebooting...", true);
+  } else if (status.state == "running") {
+    upload_esp_chunk(file, status.offset, retries);
+  } else {
+    finish_esp_upload((status.error.length != 0) ? status.error : "Upload Failed!", false);
+  }
+}
+
+function show_esp_upload_progress(offset) {
+  _("uploaded_size").innerHTML = "Uploaded " + offset + " bytes of " + uploaded_file_size;
+  var percent = (offset / uploaded_file_size) * 100;
   _("upload_progress_bar").value = Math.round(percent);
   _("upload_status").innerHTML = Math.round(percent) + "% uploaded... please wait";
 }
 
-function upload_complete_handler(event) {
-  command_in_progress = "";
-  _("upload_status").innerHTML = event.target.responseText;
-  if (event.target.responseText.startsWith("ERROR")) {
-    _("upload_status").style.color = "red";
-  } else {
-    _("upload_status").style.color = "green";
+function finish_esp_upload(message, is_ok) {
+  esp_firmware_upload_in_progress = false;
+  _("upload_status").innerHTML = message;
+  _("upload_status").style.color = is_ok ? "green" : "red";
+  if (is_ok) {
     setTimeout(function () {
       window.location.href = "/";
     }, 5000);
   }
 
-  _("upload_progress_bar").value = 0; //will clear progress bar after successful upload
-  _("uploaded_file_name").value = "";
-}
-
-function upload_error_handler(event) {
-  command_in_progress = "";
-  _("upload_status").innerHTML = "Upload Failed!";
-  _("upload_status").style.color = "red";
-  _("upload_progress_bar").value = 0;
-  _("uploaded_file_name").value = "";
-}
-
-function upload_abort_handler(event) {
-  command_in_progress = "";
-  _("upload_status").innerHTML = "Upload Aborted!";
-  _("upload_status").style.color = "red";
   _("upload_progress_bar").value = 0;
   _("uploaded_file_name").value = "";
 }
 
 function upload_arduino_file() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
-    return;
+  if (send_command(upload_arduino_firmware_cmd, "\"" + _("arduino_bin_path").value + "\"",
+    handle_upload_arduino_firmware_response)) {
+    _("upload_arduino_firmware_status").innerHTML = "";
+    _("upload_arduino_firmware_status").style.color = "black";
   }
-
-  _("upload_arduino_firmware_status").innerHTML = "";
-  _("upload_arduino_firmware_status").style.color = "black";
-  command_in_progress = upload_arduino_firmware_cmd;
-  connection.send(command_in_progress + " \"" + _("arduino_bin_path").value + "\"");
 }
 
-function set_server_response(element, response) {
-  element.innerHTML = "Server response: " + response;
-  command_in_progress = "";
-  if (response.startsWith("ERROR")) {
+// Returns true if response is the last one for request. Settings frame in response to "set" command means, that
+// command is successfully executed and contains new values of changed settings
+function set_server_response(element, frame) {
+  if (frame.type != frame_type_status) {
+    element.innerHTML = "Server response: DONE";
+    element.style.color = "green";
+    apply_arduino_settings(frame.settings);
+    return true;
+  }
+
+  element.innerHTML = "Server response: " + frame.message;
+  if (frame.status == status_error || frame.status == status_busy) {
     element.style.color = "red";
-    return;
+    return true;
   }
-  if (response == "DONE") {
+  if (frame.status == status_done) {
     element.style.color = "green";
-    return;
+    return true;
   }
+  return false;
 }
 
-function handle_upload_arduino_firmware_response(response) {
+function handle_upload_arduino_firmware_response(frame) {
+  // There are several responses from ESP during flashing. Request is finished only in case of error or successfull
+  // finish
   var view = _("upload_arduino_firmware_status");
-  set_server_response(view, response);
+  return set_server_response(view, frame);
 }
 
 function reset_wifi_settings() {
@@ -194,34 +391,23 @@ function reboot_esp() {
 }
 
 function reboot_arduino() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
+  if (is_command_in_progress(reboot_arduino_cmd)) {
+    alert("ERROR: command \"" + reboot_arduino_cmd + "\" is still in progress");
     return;
   }
 
   if (confirm("Are you sure you want to reboot Arduino?")) {
     _("arduino_reboot_status").innerHTML = "";
     _("arduino_reboot_status").style.color = "black";
-    command_in_progress = reboot_arduino_cmd;
-    connection.send(command_in_progress);
+    send_command(reboot_arduino_cmd, "", handle_reboot_arduino_response);
   }
 }
 
-function handle_reboot_arduino_response(response) {
-  // Do NOT call set_server_response() here, because there are several responses from ESP during reboot and we need to
-  // clear command_in_progress only in case of error or successfull finish
+function handle_reboot_arduino_response(frame) {
+  // There are several responses from ESP during reboot. Request is finished only in case of error or successfull
+  // finish
   var element = _("arduino_reboot_status");
-  element.innerHTML = "Server response: " + response;
-  if (response.startsWith("ERROR")) {
-    command_in_progress = "";
-    element.style.color = "red";
-    return;
-  }
-  if (response == "DONE") {
-    command_in_progress = "";
-    element.style.color = "green";
-    return;
-  }
+  return set_server_response(element, frame);
 }
 
 function check_sunrise_duration() {
@@ -269,8 +455,8 @@ function disable_arduino_settings_controls(disable) {
 }
 
 function refresh_arduino_settings() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
+  if (is_command_in_progress(get_arduino_settings_cmd)) {
+    alert("ERROR: command \"" + get_arduino_settings_cmd + "\" is still in progress");
     return;
   }
 
@@ -279,49 +465,38 @@ function refresh_arduino_settings() {
 }
 
 function get_arduino_settings() {
+  if (!send_settings_command(get_arduino_settings_cmd, frame_type_get_settings, [],
+    handle_get_arduino_settings_response)) {
+    return;
+  }
   disable_arduino_settings_controls(true);
-  command_in_progress = get_arduino_settings_cmd;
   _("arduino_settings_status").innerHTML = "Updating Arduino settings...";
   _("arduino_settings_status").style.color = "black";
-  connection.send(command_in_progress);
 }
 
-function handle_get_arduino_settings_response(response) {
-  command_in_progress = "";
-
-  var results_json = JSON.parse(response);
-  var time_str = results_json["time"];
-  var alarm_str = results_json["alarm"];
-  var sd_str = results_json["sunrise duration"];
-  var brightness_str = results_json["brightness"];
+function handle_get_arduino_settings_response(frame) {
+  if (frame.type == frame_type_status) {
+    _("arduino_settings_status").innerHTML = "Server response: " + frame.message;
+    _("arduino_settings_status").style.color = "red";
+    toggle_loading_animation();
+    return true;
+  }
 
   // Check for errors
   var server_response = "";
-  if (time_str.startsWith("ERROR")) {
-    server_response += "Get time error: " + time_str + "; ";
-  } else {
-    set_arduino_time(time_str);
-    disable_arduino_time_controls(false);
+  if (frame.errors.time) {
+    server_response += "Get time error; ";
   }
-
-  if (alarm_str.startsWith("ERROR")) {
-    server_response += "Get alarm error: " + alarm_str + "; ";
-  } else {
-    set_arduino_alarm(alarm_str);
+  if (frame.errors.alarm) {
+    server_response += "Get alarm error; ";
   }
-
-  if (sd_str.startsWith("ERROR")) {
-    server_response += "Get sunset duration error: " + sd_str + "; ";
-  } else {
-    set_arduino_sunrise_duration(sd_str);
-    disable_arduino_sunrise_duration_controls(false);
+  if (frame.errors.sunrise_duration) {
+    server_response += "Get sunset duration error; ";
   }
-
-  if (brightness_str.startsWith("ERROR")) {
-    server_response += "Get brightness error: " + brightness_str;
-  } else {
-    set_arduino_brightness(brightness_str);
+  if (frame.errors.brightness) {
+    server_response += "Get brightness error";
   }
+  apply_arduino_settings(frame.settings);
 
   if (server_response.length != 0) {
     _("arduino_settings_status").innerHTML = "Server response: " + server_response;
@@ -331,16 +506,34 @@ function handle_get_arduino_settings_response(response) {
     _("arduino_settings_status").style.color = "green";
   }
   toggle_loading_animation();
+  return true;
+}
+
+// Update controls with received settings. Only settings, present in "settings" object, are updated
+function apply_arduino_settings(settings) {
+  if (settings.time !== undefined) {
+    set_arduino_time(settings.time);
+    disable_arduino_time_controls(false);
+  }
+  if (settings.alarm !== undefined) {
+    set_arduino_alarm(settings.alarm);
+  }
+  if (settings.sunrise_duration !== undefined) {
+    set_arduino_sunrise_duration(settings.sunrise_duration);
+    disable_arduino_sunrise_duration_controls(false);
+  }
+  if (settings.brightness !== undefined) {
+    set_arduino_brightness(settings.brightness);
+  }
 }
 
-function set_arduino_time(time_str) {
-  var year = time_str.substring(15, 19);
-  var day = time_str.substring(9, 11);
-  var month = time_str.substring(12, 14);
-  var hour = time_str.substring(0, 2);
-  var minute = time_str.substring(3, 5);
-  var sec = time_str.substring(6, 8);
-  var input_date = year + "-" + month + "-" + day + "T" + hour + ":" + minute + ":" + sec;
+function two_digits(value) {
+  return value.toString().padStart(2, "0");
+}
+
+function set_arduino_time(time) {
+  var input_date = time.year.toString().padStart(4, "0") + "-" + two_digits(time.month) + "-" + two_digits(time.day) +
+    "T" + two_digits(time.hour) + ":" + two_digits(time.minute) + ":" + two_digits(time.second);
   _("datetime").value = input_date;
 }
 
@@ -349,21 +542,16 @@ function update_alarm_controls() {
   _("enable_alarm").textContent = (alarm_enabled) ? "Disable" : "Enable";
 }
 
-function set_arduino_alarm(alarm_str) {
-  alarm_enabled = (alarm_str.substring(0, 1) == "E");
+function set_arduino_alarm(alarm) {
+  alarm_enabled = alarm.enabled;
   update_alarm_controls();
   _("enable_alarm").disabled = false;
 
-  var hour = alarm_str.substring(2, 4);
-  var minute = alarm_str.substring(5, 7);
-  _("alarm").value = hour + ":" + minute;
-
-  var dow = alarm_str.substring(8, 10);
-  set_dow(dow);
+  _("alarm").value = two_digits(alarm.hour) + ":" + two_digits(alarm.minute);
+  set_dow(alarm.dow);
 }
 
-function set_dow(dow) {
-  var dow_num = Number.parseInt(dow, 16);
+function set_dow(dow_num) {
   for (i = 0; i < 7; i++) {
     var mask = 1 << i;
     var value = dow_num & mask;
@@ -384,18 +572,14 @@ function get_dow() {
   return dow_num;
 }
 
-function set_arduino_sunrise_duration(sd_str) {
-  var sd_num = Number.parseInt(sd_str);
-  _("sunrise_duration").value = sd_num;
+function set_arduino_sunrise_duration(sunrise_duration) {
+  _("sunrise_duration").value = sunrise_duration;
 }
 
-function set_arduino_brightness(brightness_str) {
-  var is_auto_mode = (brightness_str.substring(0, 1) == "A");
-  disable_arduino_brightness_controls(!is_auto_mode);
-  _("brightness_manual_mode_sign").style.visibility = is_auto_mode ? 'hidden' : 'visible';
-
-  var brightness = Number.parseInt(brightness_str.substring(2));
-  _("brightness").value = brightness;
+function set_arduino_brightness(brightness) {
+  disable_arduino_brightness_controls(!brightness.is_auto);
+  _("brightness_manual_mode_sign").style.visibility = brightness.is_auto ? 'hidden' : 'visible';
+  _("brightness").value = brightness.value;
 }
 
 function check_brightness() {
@@ -408,109 +592,98 @@ function check_brightness() {
 }
 
 function set_datetime() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
-    return;
+  var datetime_str = _("datetime").value;
+  var year = Number.parseInt(datetime_str.substring(0, 4));
+  var month = Number.parseInt(datetime_str.substring(5, 7));
+  var day = Number.parseInt(datetime_str.substring(8, 10));
+  var hour = Number.parseInt(datetime_str.substring(11, 13));
+  var min = Number.parseInt(datetime_str.substring(14, 16));
+  var sec = Number.parseInt(datetime_str.substring(17, 19));
+  if (Number.isNaN(sec)) {
+    sec = 0;
   }
+  var payload = [hour, min, sec, day, month].concat(uint16_bytes(year));
 
-  var datetime_str = _("datetime").value;
-  var year = datetime_str.substring(0, 4);
-  var month = datetime_str.substring(5, 7);
-  var day = datetime_str.substring(8, 10);
-  var hour = datetime_str.substring(11, 13);
-  var min = datetime_str.substring(14, 16);
-  var sec = datetime_str.substring(17, 19);
-  if (sec.length == 0) {
-    sec = "00";
-  }
-  var arduino_datetime_str = hour + ":" + min + ":" + sec + " " + day + "/" + month + "/" + year;
-
-  _("arduino_settings_status").innerHTML = "Status: setting datetime...";
-  _("arduino_settings_status").style.color = "black";
-  command_in_progress = set_arduino_datetime_cmd;
-  connection.send(command_in_progress + " " + arduino_datetime_str);
+  if (send_settings_command(set_arduino_datetime_cmd, frame_type_set_datetime, payload,
+    handle_set_arduino_datetime_response)) {
+    _("arduino_settings_status").innerHTML = "Status: setting datetime...";
+    _("arduino_settings_status").style.color = "black";
+  }
 }
 
-function handle_set_arduino_datetime_response(response) {
+function handle_set_arduino_datetime_response(frame) {
   var view = _("arduino_settings_status");
-  set_server_response(view, response);
+  set_server_response(view, frame);
+  return true;
 }
 
 function set_alarm() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
-    return;
-  }
-
   var alarm_str = _("alarm").value;
-  var hour = alarm_str.substring(0, 2);
-  var min = alarm_str.substring(3, 5);
+  var hour = Number.parseInt(alarm_str.substring(0, 2));
+  var min = Number.parseInt(alarm_str.substring(3, 5));
   var dow = get_dow();
-  var arduino_alarm_str = hour + ":" + min + " " + dow.toString(16);
 
-  _("arduino_settings_status").innerHTML = "Status: setting alarm time...";
-  _("arduino_settings_status").style.color = "black";
-  command_in_progress = set_arduino_alarm_time_cmd;
-  connection.send(command_in_progress + " " + arduino_alarm_str);
+  if (send_settings_command(set_arduino_alarm_time_cmd, frame_type_set_alarm_time, [hour, min, dow],
+    handle_set_arduino_alarm_time_response)) {
+    _("arduino_settings_status").innerHTML = "Status: setting alarm time...";
+    _("arduino_settings_status").style.color = "black";
+  }
 }
 
-function handle_set_arduino_alarm_time_response(response) {
+function handle_set_arduino_alarm_time_response(frame) {
   var view = _("arduino_settings_status");
-  set_server_response(view, response);
+  set_server_response(view, frame);
+  return true;
 }
 
 function enable_alarm() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
-    return;
+  if (send_settings_command(enable_arduino_alarm_cmd, frame_type_enable_alarm, [alarm_enabled ? 0 : 1],
+    handle_enable_arduino_alarm_response)) {
+    _("arduino_settings_status").innerHTML = "Status: " + (alarm_enabled ? "disabling" : "enabling") + " alarm...";
+    _("arduino_settings_status").style.color = "black";
   }
-
-  _("arduino_settings_status").innerHTML = "Status: " + (alarm_enabled ? "disabling" : "enabling") + " alarm...";
-  _("arduino_settings_status").style.color = "black";
-  command_in_progress = enable_arduino_alarm_cmd;
-  connection.send(command_in_progress + (alarm_enabled ? " D" : " E"));
 }
 
-function handle_enable_arduino_alarm_response(response) {
+function handle_enable_arduino_alarm_response(frame) {
   var view = _("arduino_settings_status");
-  set_server_response(view, response);
+  set_server_response(view, frame);
 
-  alarm_enabled = !alarm_enabled;
-  update_alarm_controls();
+  // If ESP doesn't know current alarm settings, it replies with plain status instead of new alarm settings
+  if (frame.type == frame_type_status && frame.status == status_done) {
+    alarm_enabled = !alarm_enabled;
+    update_alarm_controls();
+  }
+  return true;
 }
 
 function set_sunrise_duration() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
-    return;
+  var payload = uint16_bytes(Number.parseInt(_("sunrise_duration").value));
+  if (send_settings_command(set_arduino_sunrise_duration_cmd, frame_type_set_sunrise_duration, payload,
+    handle_set_arduino_sunrise_duration_response)) {
+    _("arduino_settings_status").innerHTML = "Status: setting sunrise duration...";
+    _("arduino_settings_status").style.color = "black";
   }
-
-  _("arduino_settings_status").innerHTML = "Status: setting sunrise duration...";
-  _("arduino_settings_status").style.color = "black";
-  command_in_progress = set_arduino_sunrise_duration_cmd;
-  connection.send(command_in_progress + " " + _("sunrise_duration").value.toString().padStart(4, "0"));
 }
 
-function handle_set_arduino_sunrise_duration_response(response) {
+function handle_set_arduino_sunrise_duration_response(frame) {
   var view = _("arduino_settings_status");
-  set_server_response(view, response);
+  set_server_response(view, frame);
+  return true;
 }
 
 function set_brightness() {
-  if (command_in_progress.length != 0) {
-    alert("ERROR: command \"" + command_in_progress + "\" is still in progress");
-    return;
+  var payload = uint16_bytes(Number.parseInt(_("brightness").value));
+  if (send_settings_command(set_arduino_brightness_cmd, frame_type_set_brightness, payload,
+    handle_set_arduino_brightness_response)) {
+    _("arduino_settings_status").innerHTML = "Status: setting brightness...";
+    _("arduino_settings_status").style.color = "black";
   }
-
-  _("arduino_settings_status").innerHTML = "Status: setting brightness...";
-  _("arduino_settings_status").style.color = "black";
-  command_in_progress = set_arduino_brightness_cmd;
-  connection.send(command_in_progress + " " + _("brightness").value.toString().padStart(4, "0"));
 }
 
-function handle_set_arduino_brightness_response(response) {
+function handle_set_arduino_brightness_response(frame) {
   var view = _("arduino_settings_status");
-  set_server_response(view, response);
+  set_server_response(view, frame);
+  return true;
 }
 
 function toggle_loading_animation() {
@@ -0,0 +1,93 @@
+// Compact binary encoding of settings channel. Layout of frames is described in SettingsCodec.h on ESP side.
+// Every frame starts with frame type and 32-bit request ID. All numbers are little-endian.
+
+var frame_type_settings_snapshot = 0x01;
+var frame_type_settings_delta = 0x02;
+var frame_type_status = 0x03;
+var frame_type_get_settings = 0x10;
+var frame_type_set_datetime = 0x11;
+var frame_type_enable_alarm = 0x12;
+var frame_type_set_alarm_time = 0x13;
+var frame_type_set_sunrise_duration = 0x14;
+var frame_type_set_brightness = 0x15;
+
+var status_done = 0;
+var status_error = 1;
+var status_info = 2;
+var status_busy = 3;
+
+// Order of fields in settings frames and bits of fields masks
+var settings_fields = ["time", "alarm", "sunrise_duration", "brightness"];
+
+// "payload" is array of bytes
+function encode_settings_command(frame_type, request_id, payload) {
+  var frame = new Uint8Array(5 + payload.length);
+  var view = new DataView(frame.buffer);
+  view.setUint8(0, frame_type);
+  view.setUint32(1, request_id, true);
+  frame.set(payload, 5);
+  return frame.buffer;
+}
+
+function uint16_bytes(value) {
+  return [value & 0xFF, (value >> 8) & 0xFF];
+}
+
+// Returns null if frame is malformed
+function decode_settings_frame(buffer) {
+  var view = new DataView(buffer);
+  if (view.byteLength < 5) {
+    return null;
+  }
+
+  var frame = { type: view.getUint8(0), request_id: view.getUint32(1, true) };
+  if (frame.type == frame_type_status) {
+    frame.status = view.getUint8(5);
+    frame.message = new TextDecoder().decode(new Uint8Array(buffer, 6));
+    return frame;
+  }
+  if (frame.type != frame_type_settings_snapshot && frame.type != frame_type_settings_delta) {
+    return null;
+  }
+
+  var present_mask = view.getUint8(5);
+  var error_mask = view.getUint8(6);
+  var offset = 7;
+  frame.settings = {};
+  frame.errors = {};
+  for (var i = 0; i < settings_fields.length; i++) {
+    var field = settings_fields[i];
+    frame.errors[field] = (error_mask & (1 << i)) != 0;
+    if ((present_mask & (1 << i)) == 0) {
+      continue;
+    }
+
+    switch (field) {
+      case "time":
+        frame.settings.time = {
+          hour: view.getUint8(offset), minute: view.getUint8(offset + 1), second: view.getUint8(offset + 2),
+          day: view.getUint8(offset + 3), month: view.getUint8(offset + 4), year: view.getUint16(offset + 5, true)
+        };
+        offset += 7;
+        break;
+      case "alarm":
+        frame.settings.alarm = {
+          enabled: (view.getUint8(offset) & 1) != 0, hour: view.getUint8(offset + 1),
+          minute: view.getUint8(offset + 2), dow: view.getUint8(offset + 3)
+        };
+        offset += 4;
+        break;
+      case "sunrise_duration":
+        frame.settings.sunrise_duration = view.getUint16(offset, true);
+        offset += 2;
+        break;
+      case "brightness":
+        frame.settings.brightness = {
+          is_auto: (view.getUint8(offset) & 1) != 0, value: view.getUint16(offset + 1, true)
+        };
+        offset += 3;
+        break;
+    }
+  }
+  return frame;
+}
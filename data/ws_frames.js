@@ -0,0 +1,21 @@
+// ESP merges small messages, sent to the same client, into one WebSocket frame (see WebSocketServer.h).
+// Such frame starts with batch marker, followed by records [length: 2 bytes, little-endian][message].
+var batch_marker = 0x1E;
+
+// Returns array of messages (ArrayBuffer) from received frame
+function split_ws_frame(buffer) {
+  var bytes = new Uint8Array(buffer);
+  if (bytes.length == 0 || bytes[0] != batch_marker) {
+    return [buffer];
+  }
+
+  var messages = [];
+  var offset = 1;
+  while (offset + 2 <= bytes.length) {
+    var length = bytes[offset] | (bytes[offset + 1] << 8);
+    offset += 2;
+    messages.push(buffer.slice(offset, offset + length));
+    offset += length;
+  }
+  return messages;
+}
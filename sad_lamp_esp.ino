@@ -3,9 +3,12 @@
 #include <FS.h>
 #include <FTPServer.h>
 #include <WiFiManager.h>
+#include <lwip/priv/tcp_priv.h>
 
 #include "src/ArduinoCommunication.h"
 #include "src/DebugServer.h"
+#include "src/FsIndex.h"
+#include "src/LogSpooler.h"
 #include "src/WebServer.h"
 #include "src/WebSocketServer.h"
 #include "src/logger.h"
@@ -18,9 +21,13 @@ WebServer            web_server;
 DebugServer          debug_server(web_socket_server);
 ArduinoCommunication arduino_communication(web_socket_server, web_server, RESET_PIN);
 FTPServer            ftp_server(SPIFFS);
+LogSpooler           log_spooler(should_spool_logs_to_flash);
 
 bool                    is_reboot_requested{false};
 constexpr unsigned long reboot_delay{100};  // Reboot happens 100ms after receiving reboot request
+
+constexpr uint16_t ftp_control_port{21};  // Default of FTPServer, see FTPCommon.h
+bool               was_ftp_client_connected{false};
 }  // namespace
 
 void
@@ -42,6 +49,8 @@ setup()
     init_wifi();
     debug_server.init();
     SPIFFS.begin();
+    FsIndex::instance().init();
+    log_spooler.init();
     web_server.init();
     SSDP_init();
     ftp_init();
@@ -67,12 +76,23 @@ loop()
     debug_server.loop();
     web_server.loop();
     ftp_server.handleFTP();
+    FsIndex::instance().loop();  // Pick up changes, done over FTP
+    // FTP client can overwrite file with content of the same size, which can not be detected by FsIndex. So cached
+    // hashes of content are dropped, when FTP client connects and when it disconnects. Hashes, calculated during FTP
+    // session, can become stale before it ends
+    bool is_ftp_client_connected_now = is_ftp_client_connected();
+    if (is_ftp_client_connected_now != was_ftp_client_connected) {
+        FsIndex::instance().invalidate_content_hashes();
+        was_ftp_client_connected = is_ftp_client_connected_now;
+    }
+    log_spooler.loop();
 
     if (is_reboot_requested) {
         // If reboot of ESP is requested, it is triggered not immediately, but with reboot_delay. It lets ESP to finish
         // some actions, ex. sending responses to Web-clients, etc.
         static unsigned long reboot_request_time = millis();
         if (millis() - reboot_request_time >= reboot_delay) {
+            log_spooler.flush();
             ESP.restart();
             delay(5000);
         }
@@ -164,3 +184,16 @@ ftp_init()
     ftp_server.begin(F("esp8266"), F("esp8266"));
     DEBUG_PRINTLN(F("FTP server initialized"));
 }
+
+bool
+is_ftp_client_connected()
+{
+    // FTPServer doesn't report its state, so look for established control connection in lwIP. Active list also keeps
+    // connections, which are being opened or closed, so state is checked
+    for (tcp_pcb* pcb = tcp_active_pcbs; pcb != nullptr; pcb = pcb->next) {
+        if ((pcb->local_port == ftp_control_port) && (pcb->state == ESTABLISHED)) {
+            return true;
+        }
+    }
+    return false;
+}
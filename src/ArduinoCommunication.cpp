@@ -3,6 +3,7 @@
 #include <FS.h>
 
 #include "IntelHexParser.h"
+#include "SettingsCodec.h"
 #include "Stk500Protocol.h"
 #include "logger.h"
 
@@ -41,6 +42,9 @@ constexpr char esp_reset_cmd[] PROGMEM = "TOESP: RESETESP";
 constexpr char error_timeout[] PROGMEM = "ERROR: timeout";
 constexpr char hex_chars[] PROGMEM     = "0123456789ABCDEF";
 
+// Settings are requested by ESP itself, not by WebSocket client
+constexpr uint8_t no_client{0xFF};
+
 bool
 flash_page(IntelHexParser& hex_parser, Stk500Protocol& stk500_protocol)
 {
@@ -64,30 +68,44 @@ ArduinoCommunication::ArduinoCommunication(WebSocketServer& web_socket_server, W
 void
 ArduinoCommunication::init()
 {
+    using RequestId = WebSocketServer::RequestId;
     web_socket_server_.set_handler(WebSocketServer::Event::ARDUINO_COMMAND,
-                                   [&](uint8_t client_id, String const& parameters) { send(parameters); });
-    web_socket_server_.set_handler(
-        WebSocketServer::Event::FLASH_ARDUINO,
-        [&](uint8_t client_id, String const& parameters) { flash_arduino(client_id, parameters); });
-    web_socket_server_.set_handler(WebSocketServer::Event::REBOOT_ARDUINO,
-                                   [&](uint8_t client_id, String const&) { reboot_arduino(client_id); });
-    web_socket_server_.set_handler(WebSocketServer::Event::GET_ARDUINO_SETTINGS,
-                                   [&](uint8_t client_id, String const&) { get_arduino_settings(client_id); });
-    web_socket_server_.set_handler(
-        WebSocketServer::Event::ARDUINO_SET_DATETIME,
-        [&](uint8_t client_id, String const& parameters) { send_set_command("st", client_id, parameters); });
-    web_socket_server_.set_handler(
-        WebSocketServer::Event::ENABLE_ARDUINO_ALARM,
-        [&](uint8_t client_id, String const& parameters) { send_set_command("ea", client_id, parameters); });
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       send_raw_command(client_id, request_id, parameters);
+                                   });
+    web_socket_server_.set_handler(WebSocketServer::Event::FLASH_ARDUINO,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       flash_arduino(client_id, request_id, parameters);
+                                   });
     web_socket_server_.set_handler(
-        WebSocketServer::Event::SET_ARDUINO_ALARM_TIME,
-        [&](uint8_t client_id, String const& parameters) { send_set_command("sa", client_id, parameters); });
+        WebSocketServer::Event::REBOOT_ARDUINO,
+        [&](uint8_t client_id, RequestId request_id, String const&) { reboot_arduino(client_id, request_id); });
     web_socket_server_.set_handler(
-        WebSocketServer::Event::SET_ARDUINO_SUNRISE_DURATION,
-        [&](uint8_t client_id, String const& parameters) { send_set_command("ssd", client_id, parameters); });
-    web_socket_server_.set_handler(
-        WebSocketServer::Event::SET_ARDUINO_BRIGHTNESS,
-        [&](uint8_t client_id, String const& parameters) { send_set_command("sb", client_id, parameters); });
+        WebSocketServer::Event::GET_ARDUINO_SETTINGS,
+        [&](uint8_t client_id, RequestId request_id, String const&) { get_arduino_settings(client_id, request_id); });
+    web_socket_server_.set_handler(WebSocketServer::Event::ARDUINO_SET_DATETIME,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       send_set_command("st", client_id, request_id, parameters);
+                                   });
+    web_socket_server_.set_handler(WebSocketServer::Event::ENABLE_ARDUINO_ALARM,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       send_set_command("ea", client_id, request_id, parameters);
+                                   });
+    web_socket_server_.set_handler(WebSocketServer::Event::SET_ARDUINO_ALARM_TIME,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       send_set_command("sa", client_id, request_id, parameters);
+                                   });
+    web_socket_server_.set_handler(WebSocketServer::Event::SET_ARDUINO_SUNRISE_DURATION,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       send_set_command("ssd", client_id, request_id, parameters);
+                                   });
+    web_socket_server_.set_handler(WebSocketServer::Event::SET_ARDUINO_BRIGHTNESS,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       send_set_command("sb", client_id, request_id, parameters);
+                                   });
+
+    // Fill cache of lamp state for web server. Afterwards it is updated, when clients read or change settings
+    get_arduino_settings(no_client, WebSocketServer::NO_REQUEST_ID);
 }
 
 void
@@ -99,7 +117,9 @@ ArduinoCommunication::loop()
         auto& current_command = command_queue_.front();
 
         if (current_command.execution_started && (millis() >= current_command.response_timeout)) {
-            DEBUG_PRINTLN(PSTR("ERROR: response timeout expired for command \"") + current_command.name + '\"');
+            LOG_WARNING(ARDUINO,
+                        PSTR("ERROR: response timeout expired for command \"%s\"\n"),
+                        current_command.name.c_str());
             if (current_command.response_timeout_handler) {
                 current_command.response_timeout_handler();
             }
@@ -118,7 +138,7 @@ ArduinoCommunication::loop()
 void
 ArduinoCommunication::send(String const& message) const
 {
-    DEBUG_PRINTLN(PSTR("TO   ARDUINO: ") + message);
+    LOG_DEBUG(ARDUINO, PSTR("TO   ARDUINO: %s\n"), message.c_str());
     Serial.println(message);
 }
 
@@ -149,7 +169,7 @@ ArduinoCommunication::receive_line()
         buffer_[current_buf_position_] = 0;
         current_buf_position_          = 0;
         String message{buffer_.data()};
-        DEBUG_PRINTLN(PSTR("FROM ARDUINO: ") + message);
+        LOG_DEBUG(ARDUINO, PSTR("FROM ARDUINO: %s\n"), message.c_str());
 
         process_message_from_arduino(message);
     }
@@ -177,12 +197,37 @@ ArduinoCommunication::process_message_from_arduino(String const& message)
 }
 
 void
-ArduinoCommunication::flash_arduino(uint8_t client_id, String const& path)
+ArduinoCommunication::send_raw_command(uint8_t client_id, WebSocketServer::RequestId request_id, String const& command)
+{
+    // Format of reply is not known, so the first line from Arduino is taken as reply. Command goes through the queue,
+    // so this line can not be reply to another command. Only client, which uses correlation envelope, gets the reply.
+    // Others see it in logs, as before
+    ArduinoCommand raw_command(
+        F("raw"),
+        [&, command]() { send(command); },
+        [&, client_id, request_id](String const& response) {
+            if (request_id != WebSocketServer::NO_REQUEST_ID) {
+                web_socket_server_.send(client_id, response, request_id);
+            }
+            return true;
+        });
+    raw_command.response_timeout_handler = [&, client_id, request_id]() {
+        if (request_id != WebSocketServer::NO_REQUEST_ID) {
+            web_socket_server_.send(client_id, FPSTR(error_timeout), request_id);
+        }
+    };
+    raw_command.request_start_time = 0;  // Start immediately
+    raw_command.response_timeout   = default_arduino_cmd_timeout;
+    command_queue_.push(raw_command);
+}
+
+void
+ArduinoCommunication::flash_arduino(uint8_t client_id, WebSocketServer::RequestId request_id, String const& path)
 {
     if (path.isEmpty() || path == "/") {
         String message{F("ERROR: invalid path")};
-        DEBUG_PRINTLN(message);
-        web_socket_server_.send(client_id, message);
+        LOG_ERROR(ARDUINO, PSTR("%s\n"), message.c_str());
+        web_socket_server_.send(client_id, message, request_id);
         return;
     }
 
@@ -195,13 +240,14 @@ ArduinoCommunication::flash_arduino(uint8_t client_id, String const& path)
     File file{SPIFFS.open(path, "r")};
     if (!file) {
         String message{PSTR("ERROR: can not open file with Arduino firmware \"") + path + "\""};
-        DEBUG_PRINTLN(message);
-        web_socket_server_.send(client_id, message);
+        LOG_ERROR(ARDUINO, PSTR("%s\n"), message.c_str());
+        web_socket_server_.send(client_id, message, request_id);
         return;
     }
 
-    DEBUG_PRINTLN(F("Start flashing Arduino..."));
-    web_socket_server_.send(client_id, F("START FLASHING"));
+    LOG_INFO(STK500, PSTR("Start flashing Arduino...\n"));
+    // Flashing blocks main loop for a long time, so client should be notified immediately
+    web_socket_server_.send(client_id, F("START FLASHING"), request_id, WebSocketServer::Priority::URGENT);
 
     Stk500Protocol stk500_protocol(&Serial, reset_pin_);
     stk500_protocol.setup_device();
@@ -213,8 +259,8 @@ ArduinoCommunication::flash_arduino(uint8_t client_id, String const& path)
         String           line{file.readStringUntil('\n')};
         if (line.length() >= buf_len) {
             String message{PSTR("ERROR: one line of hex file is longer than ") + String(buf_len) + PSTR(" characters")};
-            DEBUG_PRINTLN(message);
-            web_socket_server_.send(client_id, message);
+            LOG_ERROR(STK500, PSTR("%s\n"), message.c_str());
+            web_socket_server_.send(client_id, message, request_id);
             return;
         }
         line.getBytes(buff, line.length());
@@ -223,8 +269,8 @@ ArduinoCommunication::flash_arduino(uint8_t client_id, String const& path)
         if (hex_parser.is_page_ready()) {
             if (!flash_page(hex_parser, stk500_protocol)) {
                 String message{F("ERROR: flashing of Arduino failed!")};
-                DEBUG_PRINTLN(message);
-                web_socket_server_.send(client_id, message);
+                LOG_ERROR(STK500, PSTR("%s\n"), message.c_str());
+                web_socket_server_.send(client_id, message, request_id);
                 return;
             }
         }
@@ -234,16 +280,16 @@ ArduinoCommunication::flash_arduino(uint8_t client_id, String const& path)
     file.close();
     Serial.begin(9600);
 
-    DEBUG_PRINTLN(F("Flashing of Arduino is completed."));
-    web_socket_server_.send(client_id, F("DONE"));
+    LOG_INFO(STK500, PSTR("Flashing of Arduino is completed.\n"));
+    web_socket_server_.send(client_id, F("DONE"), request_id);
 }
 
 void
-ArduinoCommunication::reboot_arduino(uint8_t client_id)
+ArduinoCommunication::reboot_arduino(uint8_t client_id, WebSocketServer::RequestId request_id)
 {
     String message{F("Start rebooting Arduino...")};
-    DEBUG_PRINTLN(message);
-    web_socket_server_.send(client_id, message);
+    LOG_INFO(ARDUINO, PSTR("%s\n"), message.c_str());
+    web_socket_server_.send(client_id, message, request_id, WebSocketServer::Priority::URGENT);
 
     digitalWrite(reset_pin_, LOW);
     delay(1);
@@ -253,24 +299,26 @@ ArduinoCommunication::reboot_arduino(uint8_t client_id)
     ArduinoCommand reconnect(
         F("connect"),
         [&]() { Serial.print(FPSTR(arduino_connect_cmd)); },
-        [&, client_id](String const& response) {
+        [&, client_id, request_id](String const& response) {
             if (response == FPSTR(arduino_connect_ack)) {
-                DEBUG_PRINTLN(F("Arduino reboot finished"));
-                web_socket_server_.send(client_id, F("DONE"));
+                LOG_INFO(ARDUINO, PSTR("Arduino reboot finished\n"));
+                web_socket_server_.send(client_id, F("DONE"), request_id);
                 return true;
             }
             return false;
         });
-    reconnect.response_timeout_handler = [&, client_id]() { web_socket_server_.send(client_id, FPSTR(error_timeout)); };
+    reconnect.response_timeout_handler = [&, client_id, request_id]() {
+        web_socket_server_.send(client_id, FPSTR(error_timeout), request_id);
+    };
     reconnect.request_start_time       = millis() + arduino_reconnect_timeout;
     reconnect.response_timeout         = default_arduino_cmd_timeout;
     command_queue_.push(reconnect);
 }
 
 void
-ArduinoCommunication::get_arduino_settings(uint8_t client_id)
+ArduinoCommunication::get_arduino_settings(uint8_t client_id, WebSocketServer::RequestId request_id)
 {
-    arduino_settings_json_ = "{";
+    using Field = ArduinoSettings::Field;
 
     // 1
     ArduinoCommand get_time_cmd(
@@ -278,18 +326,15 @@ ArduinoCommunication::get_arduino_settings(uint8_t client_id)
         [&]() { Serial.print(FPSTR(arduino_get_time_cmd)); },
         [&](String const& response) {
             if (response.startsWith(FPSTR(arduino_get_time_ack))) {
-                arduino_settings_json_ +=
-                    PSTR("\"time\":\"") +
-                    response.substring(sizeof(arduino_get_time_ack) / sizeof(arduino_get_time_ack[0]) - 1) + "\",";
+                settings_.parse(Field::TIME,
+                                response.substring(sizeof(arduino_get_time_ack) / sizeof(arduino_get_time_ack[0]) - 1));
                 return true;
             }
             return false;
         });
-    get_time_cmd.response_timeout_handler = [&]() {
-        arduino_settings_json_ += String(PSTR("\"time\":\"")) + FPSTR(error_timeout) + "\",";
-    };
-    get_time_cmd.request_start_time = 0;  // Start immediately
-    get_time_cmd.response_timeout   = default_arduino_cmd_timeout;
+    get_time_cmd.response_timeout_handler = [&]() { settings_.invalidate(Field::TIME); };
+    get_time_cmd.request_start_time       = 0;  // Start immediately
+    get_time_cmd.response_timeout         = default_arduino_cmd_timeout;
     command_queue_.push(get_time_cmd);
 
     // 2
@@ -298,18 +343,16 @@ ArduinoCommunication::get_arduino_settings(uint8_t client_id)
         [&]() { Serial.print(FPSTR(arduino_get_alarm_cmd)); },
         [&](String const& response) {
             if (response.startsWith(FPSTR(arduino_get_alarm_ack))) {
-                arduino_settings_json_ +=
-                    PSTR("\"alarm\":\"") +
-                    response.substring(sizeof(arduino_get_alarm_ack) / sizeof(arduino_get_alarm_ack[0]) - 1) + "\",";
+                settings_.parse(
+                    Field::ALARM,
+                    response.substring(sizeof(arduino_get_alarm_ack) / sizeof(arduino_get_alarm_ack[0]) - 1));
                 return true;
             }
             return false;
         });
-    get_alarm_cmd.response_timeout_handler = [&]() {
-        arduino_settings_json_ += String(PSTR("\"alarm\":\"")) + FPSTR(error_timeout) + "\",";
-    };
-    get_alarm_cmd.request_start_time = 0;  // Start immediately
-    get_alarm_cmd.response_timeout   = default_arduino_cmd_timeout;
+    get_alarm_cmd.response_timeout_handler = [&]() { settings_.invalidate(Field::ALARM); };
+    get_alarm_cmd.request_start_time       = 0;  // Start immediately
+    get_alarm_cmd.response_timeout         = default_arduino_cmd_timeout;
     command_queue_.push(get_alarm_cmd);
 
     // 3
@@ -318,42 +361,36 @@ ArduinoCommunication::get_arduino_settings(uint8_t client_id)
         [&]() { Serial.print(FPSTR(arduino_get_sunrise_duration_cmd)); },
         [&](String const& response) {
             if (response.startsWith(FPSTR(arduino_get_sunrise_duration_ack))) {
-                arduino_settings_json_ +=
-                    PSTR("\"sunrise duration\":\"") +
+                settings_.parse(
+                    Field::SUNRISE_DURATION,
                     response.substring(
-                        sizeof(arduino_get_sunrise_duration_ack) / sizeof(arduino_get_sunrise_duration_ack[0]) - 1) +
-                    "\",";
+                        sizeof(arduino_get_sunrise_duration_ack) / sizeof(arduino_get_sunrise_duration_ack[0]) - 1));
                 return true;
             }
             return false;
         });
-    get_sunrise_duration_cmd.response_timeout_handler = [&]() {
-        arduino_settings_json_ += String(PSTR("\"sunrise duration\":\"")) + FPSTR(error_timeout) + "\",";
-    };
-    get_sunrise_duration_cmd.request_start_time = 0;  // Start immediately
-    get_sunrise_duration_cmd.response_timeout   = default_arduino_cmd_timeout;
+    get_sunrise_duration_cmd.response_timeout_handler = [&]() { settings_.invalidate(Field::SUNRISE_DURATION); };
+    get_sunrise_duration_cmd.request_start_time       = 0;  // Start immediately
+    get_sunrise_duration_cmd.response_timeout         = default_arduino_cmd_timeout;
     command_queue_.push(get_sunrise_duration_cmd);
 
     // 4
     ArduinoCommand get_brightness_cmd(
         "gb",
         [&]() { Serial.print(FPSTR(arduino_get_brightness_cmd)); },
-        [&, client_id](String const& response) {
+        [&, client_id, request_id](String const& response) {
             if (response.startsWith(FPSTR(arduino_get_brightness_ack))) {
-                arduino_settings_json_ +=
-                    PSTR("\"brightness\":\"") +
-                    response.substring(sizeof(arduino_get_brightness_ack) / sizeof(arduino_get_brightness_ack[0]) - 1) +
-                    "\"}";
-                DEBUG_PRINTLN(PSTR("Arduino settings: \"") + arduino_settings_json_ + "\"");
-                web_socket_server_.send(client_id, arduino_settings_json_);
+                settings_.parse(
+                    Field::BRIGHTNESS,
+                    response.substring(sizeof(arduino_get_brightness_ack) / sizeof(arduino_get_brightness_ack[0]) - 1));
+                send_settings(client_id, request_id, ArduinoSettings::all_fields_mask, true);
                 return true;
             }
             return false;
         });
-    get_brightness_cmd.response_timeout_handler = [&, client_id]() {
-        arduino_settings_json_ += String(PSTR("\"brightness\":\"")) + FPSTR(error_timeout) + "\"}";
-        DEBUG_PRINTLN(PSTR("Arduino settings: \"") + arduino_settings_json_ + "\"");
-        web_socket_server_.send(client_id, arduino_settings_json_);
+    get_brightness_cmd.response_timeout_handler = [&, client_id, request_id]() {
+        settings_.invalidate(Field::BRIGHTNESS);
+        send_settings(client_id, request_id, ArduinoSettings::all_fields_mask, true);
     };
     get_brightness_cmd.request_start_time = 0;  // Start immediately
     get_brightness_cmd.response_timeout   = default_arduino_cmd_timeout;
@@ -361,27 +398,66 @@ ArduinoCommunication::get_arduino_settings(uint8_t client_id)
 }
 
 void
-ArduinoCommunication::send_set_command(String const& set_command_name, uint8_t client_id, String const& parameters)
+ArduinoCommunication::send_settings(uint8_t                    client_id,
+                                    WebSocketServer::RequestId request_id,
+                                    uint8_t                    fields_mask,
+                                    bool                       is_snapshot)
+{
+    web_server_.set_lamp_state(settings_, fields_mask);
+    if (client_id == no_client) {
+        return;
+    }
+
+    if (web_socket_server_.encoding(client_id) == WebSocketServer::Encoding::BINARY) {
+        auto frame = SettingsCodec::encode_settings(settings_, fields_mask, is_snapshot, request_id);
+        LOG_DEBUG(ARDUINO,
+                  PSTR("Arduino settings: %u bytes, valid fields 0x%02x\n"),
+                  frame.size(),
+                  settings_.valid_fields);
+        web_socket_server_.send_binary(client_id, frame.data(), frame.size());
+        return;
+    }
+
+    // Text-based clients always receive all settings
+    auto json = settings_.to_json(FPSTR(error_timeout));
+    LOG_DEBUG(ARDUINO, PSTR("Arduino settings: \"%s\"\n"), json.c_str());
+    web_socket_server_.send(client_id, json, request_id);
+}
+
+void
+ArduinoCommunication::send_set_command(String const&              set_command_name,
+                                       uint8_t                    client_id,
+                                       WebSocketServer::RequestId request_id,
+                                       String const&              parameters)
 {
     String         command_str{String(F("ESP: ")) + set_command_name + ' ' + parameters + '\n'};
     String         ack_str{String(F("TOESP: ")) + set_command_name + F(" ACK")};
     ArduinoCommand command(
         set_command_name,
         [command_str]() { Serial.print(command_str); },
-        [&, ack_str, set_command_name](String const& response) {
+        [&, client_id, request_id, ack_str, set_command_name, parameters](String const& response) {
             if (response.startsWith(ack_str)) {
-                DEBUG_PRINTLN(String(F("Arduino command \"")) + set_command_name + FPSTR("\" finished"));
-                if (response.length() > (ack_str.length() + 1)) {
-                    web_socket_server_.send(client_id, response.substring(ack_str.length() + 1));
+                LOG_DEBUG(ARDUINO, PSTR("Arduino command \"%s\" finished\n"), set_command_name.c_str());
+                auto changed_fields = settings_.apply_set_command(set_command_name, parameters);
+                web_server_.set_lamp_state(settings_, changed_fields);
+                if ((web_socket_server_.encoding(client_id) == WebSocketServer::Encoding::BINARY) &&
+                    (changed_fields != 0)) {
+                    // Binary clients receive changed fields instead of plain acknowledgment
+                    send_settings(client_id, request_id, changed_fields, false);
+                }
+                else if (response.length() > (ack_str.length() + 1)) {
+                    web_socket_server_.send(client_id, response.substring(ack_str.length() + 1), request_id);
                 }
                 else {
-                    web_socket_server_.send(client_id, F("DONE"));
+                    web_socket_server_.send(client_id, F("DONE"), request_id);
                 }
                 return true;
             }
             return false;
         });
-    command.response_timeout_handler = [&, client_id]() { web_socket_server_.send(client_id, FPSTR(error_timeout)); };
+    command.response_timeout_handler = [&, client_id, request_id]() {
+        web_socket_server_.send(client_id, FPSTR(error_timeout), request_id);
+    };
     command.request_start_time       = 0;  // Start immediately
     command.response_timeout         = default_arduino_cmd_timeout;
     command_queue_.push(command);
@@ -7,6 +7,7 @@
 #include <WString.h>
 
 #include "ArduinoCommand.h"
+#include "ArduinoSettings.h"
 #include "WebServer.h"
 #include "WebSocketServer.h"
 
@@ -32,10 +33,18 @@ public:
 private:
     void receive_line();
     void process_message_from_arduino(String const& message);
-    void flash_arduino(uint8_t client_id, String const& path);
-    void reboot_arduino(uint8_t client_id);
-    void get_arduino_settings(uint8_t client_id);
-    void send_set_command(String const& set_command_name, uint8_t client_id, String const& parameters);
+    void send_raw_command(uint8_t client_id, WebSocketServer::RequestId request_id, String const& command);
+    void flash_arduino(uint8_t client_id, WebSocketServer::RequestId request_id, String const& path);
+    void reboot_arduino(uint8_t client_id, WebSocketServer::RequestId request_id);
+    void get_arduino_settings(uint8_t client_id, WebSocketServer::RequestId request_id);
+    void send_set_command(String const&              set_command_name,
+                          uint8_t                    client_id,
+                          WebSocketServer::RequestId request_id,
+                          String const&              parameters);
+    void send_settings(uint8_t                    client_id,
+                       WebSocketServer::RequestId request_id,
+                       uint8_t                    fields_mask,
+                       bool                       is_snapshot);
 
     WebSocketServer&               web_socket_server_;
     WebServer&                     web_server_;
@@ -46,7 +55,7 @@ private:
     uint8_t                        reset_pin_;
 
     std::queue<ArduinoCommand> command_queue_;
-    String                     arduino_settings_json_;
+    ArduinoSettings            settings_;
 
     std::array<EventHandler, static_cast<uint8_t>(Event::NUM_OF_EVENTS)> handlers_;
 };
@@ -0,0 +1,360 @@
+#include "ArduinoSettings.h"
+
+#include <cctype>
+
+#include <Arduino.h>
+
+namespace
+{
+constexpr char field_time[] PROGMEM             = "time";
+constexpr char field_alarm[] PROGMEM            = "alarm";
+constexpr char field_sunrise_duration[] PROGMEM = "sunrise_duration";
+constexpr char field_brightness[] PROGMEM       = "brightness";
+
+constexpr char const* const field_names[] PROGMEM = {field_time, field_alarm, field_sunrise_duration, field_brightness};
+static_assert(sizeof(field_names) / sizeof(field_names[0]) ==
+                  static_cast<size_t>(ArduinoSettings::Field::NUM_OF_FIELDS),
+              "Names of all fields should be defined");
+
+// Read decimal number. Advances text to the first character after the number
+bool
+read_number(char const*& text, uint16_t& value)
+{
+    if (!isdigit(*text)) {
+        return false;
+    }
+    uint32_t result{0};
+    while (isdigit(*text)) {
+        result = result * 10 + (*text - '0');
+        if (result > 0xFFFF) {
+            return false;
+        }
+        ++text;
+    }
+    value = static_cast<uint16_t>(result);
+    return true;
+}
+
+bool
+read_number(char const*& text, uint8_t& value)
+{
+    uint16_t result{0};
+    if (!read_number(text, result) || (result > 0xFF)) {
+        return false;
+    }
+    value = static_cast<uint8_t>(result);
+    return true;
+}
+
+bool
+read_hex_number(char const*& text, uint8_t& value)
+{
+    if (!isxdigit(*text)) {
+        return false;
+    }
+    uint16_t result{0};
+    while (isxdigit(*text)) {
+        result = result * 16 + (isdigit(*text) ? (*text - '0') : (toupper(*text) - 'A' + 10));
+        if (result > 0xFF) {
+            return false;
+        }
+        ++text;
+    }
+    value = static_cast<uint8_t>(result);
+    return true;
+}
+
+bool
+skip(char const*& text, char expected)
+{
+    if (*text != expected) {
+        return false;
+    }
+    ++text;
+    return true;
+}
+
+// Format: "HH:MM:SS DD/MM/YYYY"
+bool
+parse_time(char const* text, ArduinoSettings::Time& time)
+{
+    ArduinoSettings::Time result;
+    if (read_number(text, result.hour) && skip(text, ':') && read_number(text, result.minute) && skip(text, ':') &&
+        read_number(text, result.second) && skip(text, ' ') && read_number(text, result.day) && skip(text, '/') &&
+        read_number(text, result.month) && skip(text, '/') && read_number(text, result.year)) {
+        time = result;
+        return true;
+    }
+    return false;
+}
+
+// Format: "HH:MM DOW", where DOW is hex bit mask of days of week
+bool
+parse_alarm_time(char const* text, ArduinoSettings::Alarm& alarm)
+{
+    ArduinoSettings::Alarm result{alarm};
+    if (read_number(text, result.hour) && skip(text, ':') && read_number(text, result.minute) && skip(text, ' ') &&
+        read_hex_number(text, result.dow)) {
+        alarm = result;
+        return true;
+    }
+    return false;
+}
+
+// Format: "E|D HH:MM DOW"
+bool
+parse_alarm(char const* text, ArduinoSettings::Alarm& alarm)
+{
+    if (((text[0] != 'E') && (text[0] != 'D')) || (text[1] != ' ')) {
+        return false;
+    }
+    ArduinoSettings::Alarm result;
+    result.is_enabled = (text[0] == 'E');
+    if (!parse_alarm_time(text + 2, result)) {
+        return false;
+    }
+    alarm = result;
+    return true;
+}
+
+// Format: "A|M VALUE", where "A" is automatic mode and "M" is manual mode
+bool
+parse_brightness(char const* text, ArduinoSettings::Brightness& brightness)
+{
+    if (((text[0] != 'A') && (text[0] != 'M')) || (text[1] != ' ')) {
+        return false;
+    }
+    ArduinoSettings::Brightness result;
+    result.is_auto = (text[0] == 'A');
+    text += 2;
+    if (!read_number(text, result.value)) {
+        return false;
+    }
+    brightness = result;
+    return true;
+}
+
+bool
+parse_sunrise_duration(char const* text, uint16_t& sunrise_duration)
+{
+    return read_number(text, sunrise_duration);
+}
+
+void
+append_escaped(String const& text, String& output)
+{
+    for (size_t i = 0; i < text.length(); ++i) {
+        if ((text[i] == '"') || (text[i] == '\\')) {
+            output += '\\';
+        }
+        output += text[i];
+    }
+}
+}  // namespace
+
+bool
+ArduinoSettings::is_valid(Field field) const
+{
+    return (valid_fields & field_mask(field)) != 0;
+}
+
+void
+ArduinoSettings::invalidate(Field field)
+{
+    valid_fields &= ~field_mask(field);
+    malformed_responses[static_cast<uint8_t>(field)] = String{};
+}
+
+bool
+ArduinoSettings::parse(Field field, String const& response)
+{
+    bool result{false};
+    switch (field) {
+    case Field::TIME:
+        result = parse_time(response.c_str(), time);
+        break;
+    case Field::ALARM:
+        result = parse_alarm(response.c_str(), alarm);
+        break;
+    case Field::SUNRISE_DURATION:
+        result = parse_sunrise_duration(response.c_str(), sunrise_duration);
+        break;
+    case Field::BRIGHTNESS:
+        result = parse_brightness(response.c_str(), brightness);
+        break;
+    default:
+        break;
+    }
+
+    if (result) {
+        valid_fields |= field_mask(field);
+        malformed_responses[static_cast<uint8_t>(field)] = String{};
+    }
+    else {
+        valid_fields &= ~field_mask(field);
+        malformed_responses[static_cast<uint8_t>(field)] = response;
+    }
+    return result;
+}
+
+uint8_t
+ArduinoSettings::apply_set_command(String const& command_name, String const& parameters)
+{
+    char const* text = parameters.c_str();
+    if (command_name == F("st")) {
+        if (parse_time(text, time)) {
+            valid_fields |= field_mask(Field::TIME);
+            return field_mask(Field::TIME);
+        }
+    }
+    else if (command_name == F("ssd")) {
+        if (parse_sunrise_duration(text, sunrise_duration)) {
+            valid_fields |= field_mask(Field::SUNRISE_DURATION);
+            return field_mask(Field::SUNRISE_DURATION);
+        }
+    }
+    // Commands below change only part of field. So they can be applied only if the rest of field is already known
+    else if ((command_name == F("ea")) && is_valid(Field::ALARM)) {
+        if ((text[0] == 'E') || (text[0] == 'D')) {
+            alarm.is_enabled = (text[0] == 'E');
+            return field_mask(Field::ALARM);
+        }
+    }
+    else if ((command_name == F("sa")) && is_valid(Field::ALARM)) {
+        if (parse_alarm_time(text, alarm)) {
+            return field_mask(Field::ALARM);
+        }
+    }
+    else if ((command_name == F("sb")) && is_valid(Field::BRIGHTNESS)) {
+        if (read_number(text, brightness.value)) {
+            return field_mask(Field::BRIGHTNESS);
+        }
+    }
+    return 0;
+}
+
+String
+ArduinoSettings::to_json(String const& error_message) const
+{
+    // Values are formatted in the same way as Arduino sends them, so text-based clients can parse them as before
+    auto append_invalid = [this, &error_message](Field field, String& output) {
+        auto const& response = malformed_responses[static_cast<uint8_t>(field)];
+        append_escaped(response.isEmpty() ? error_message : response, output);
+    };
+
+    char   buffer[32];
+    String result{F("{\"time\":\"")};
+    if (is_valid(Field::TIME)) {
+        snprintf_P(buffer,
+                   sizeof(buffer),
+                   PSTR("%02u:%02u:%02u %02u/%02u/%04u"),
+                   time.hour,
+                   time.minute,
+                   time.second,
+                   time.day,
+                   time.month,
+                   time.year);
+        result += buffer;
+    }
+    else {
+        append_invalid(Field::TIME, result);
+    }
+
+    result += F("\",\"alarm\":\"");
+    if (is_valid(Field::ALARM)) {
+        snprintf_P(buffer,
+                   sizeof(buffer),
+                   PSTR("%c %02u:%02u %02X"),
+                   alarm.is_enabled ? 'E' : 'D',
+                   alarm.hour,
+                   alarm.minute,
+                   alarm.dow);
+        result += buffer;
+    }
+    else {
+        append_invalid(Field::ALARM, result);
+    }
+
+    result += F("\",\"sunrise duration\":\"");
+    if (is_valid(Field::SUNRISE_DURATION)) {
+        result += sunrise_duration;
+    }
+    else {
+        append_invalid(Field::SUNRISE_DURATION, result);
+    }
+
+    result += F("\",\"brightness\":\"");
+    if (is_valid(Field::BRIGHTNESS)) {
+        snprintf_P(buffer, sizeof(buffer), PSTR("%c %u"), brightness.is_auto ? 'A' : 'M', brightness.value);
+        result += buffer;
+    }
+    else {
+        append_invalid(Field::BRIGHTNESS, result);
+    }
+
+    result += F("\"}");
+    return result;
+}
+
+PGM_P
+ArduinoSettings::field_name(Field field)
+{
+    return static_cast<PGM_P>(pgm_read_ptr(&field_names[static_cast<uint8_t>(field)]));
+}
+
+bool
+ArduinoSettings::find_field(String const& name, Field& field)
+{
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Field::NUM_OF_FIELDS); ++i) {
+        if (name == FPSTR(field_name(static_cast<Field>(i)))) {
+            field = static_cast<Field>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+String
+ArduinoSettings::field_to_json(Field field) const
+{
+    if (!is_valid(field)) {
+        return F("null");
+    }
+
+    char buffer[80];
+    switch (field) {
+    case Field::TIME:
+        snprintf_P(buffer,
+                   sizeof(buffer),
+                   PSTR("\"%04u-%02u-%02uT%02u:%02u:%02u\""),
+                   time.year,
+                   time.month,
+                   time.day,
+                   time.hour,
+                   time.minute,
+                   time.second);
+        break;
+    case Field::ALARM:
+        snprintf_P(buffer,
+                   sizeof(buffer),
+                   PSTR("{\"enabled\":%s,\"hour\":%u,\"minute\":%u,\"days_of_week\":%u}"),
+                   alarm.is_enabled ? "true" : "false",
+                   alarm.hour,
+                   alarm.minute,
+                   alarm.dow);
+        break;
+    case Field::SUNRISE_DURATION:
+        snprintf_P(buffer, sizeof(buffer), PSTR("%u"), sunrise_duration);
+        break;
+    case Field::BRIGHTNESS:
+        snprintf_P(buffer,
+                   sizeof(buffer),
+                   PSTR("{\"auto\":%s,\"value\":%u}"),
+                   brightness.is_auto ? "true" : "false",
+                   brightness.value);
+        break;
+    default:
+        return F("null");
+    }
+    return buffer;
+}
@@ -0,0 +1,82 @@
+#ifndef ARDUINOSETTINGS_H_
+#define ARDUINOSETTINGS_H_
+
+#include <array>
+
+#include <Arduino.h>
+#include <WString.h>
+
+// ESP's view of Arduino settings. Values are parsed from text responses of Arduino, so they can be encoded either in
+// legacy JSON (for text-based clients) or in compact binary form (see SettingsCodec)
+struct ArduinoSettings
+{
+    enum class Field : uint8_t
+    {
+        TIME = 0,
+        ALARM,
+        SUNRISE_DURATION,
+        BRIGHTNESS,
+
+        NUM_OF_FIELDS
+    };
+
+    struct Time
+    {
+        uint8_t  hour{0};
+        uint8_t  minute{0};
+        uint8_t  second{0};
+        uint8_t  day{0};
+        uint8_t  month{0};
+        uint16_t year{0};
+    };
+
+    struct Alarm
+    {
+        bool    is_enabled{false};
+        uint8_t hour{0};
+        uint8_t minute{0};
+        uint8_t dow{0};  // Bit mask of days of week. Bit 0 - Monday
+    };
+
+    struct Brightness
+    {
+        bool     is_auto{false};
+        uint16_t value{0};
+    };
+
+    static constexpr uint8_t field_mask(Field field)
+    {
+        return static_cast<uint8_t>(1 << static_cast<uint8_t>(field));
+    }
+    static constexpr uint8_t all_fields_mask{(1 << static_cast<uint8_t>(Field::NUM_OF_FIELDS)) - 1};
+
+    bool is_valid(Field field) const;
+    void invalidate(Field field);
+
+    // Parse response of Arduino on "get" command. Returns false if response has unexpected format
+    bool parse(Field field, String const& response);
+
+    // Update settings with parameters of successfully executed "set" command. Returns mask of changed fields
+    uint8_t apply_set_command(String const& command_name, String const& parameters);
+
+    // Legacy JSON representation of settings. Field, which could not be parsed, contains response of Arduino as is.
+    // Field, which was not received, contains error message
+    String to_json(String const& error_message) const;
+
+    // Name of field in REST API: "time", "alarm", "sunrise_duration" or "brightness"
+    static PGM_P field_name(Field field);
+    // Returns false if there is no field with such name
+    static bool find_field(String const& name, Field& field);
+    // Typed JSON value of field for REST API. Field, which is not valid, is null
+    String field_to_json(Field field) const;
+
+    Time       time;
+    Alarm      alarm;
+    uint16_t   sunrise_duration{0};
+    Brightness brightness;
+    uint8_t    valid_fields{0};  // Mask of fields, which were successfully received from Arduino
+    // Responses of Arduino, which could not be parsed. Empty for fields, which are valid or not received
+    std::array<String, static_cast<uint8_t>(Field::NUM_OF_FIELDS)> malformed_responses;
+};
+
+#endif  // ARDUINOSETTINGS_H_
@@ -1,5 +1,26 @@
 #include "BufferedLogger.h"
 
+namespace
+{
+constexpr uint32_t fnv_offset_basis{2166136261u};
+constexpr uint32_t fnv_prime{16777619u};
+
+uint32_t
+fnv1a(uint32_t hash, uint8_t const* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * fnv_prime;
+    }
+    return hash;
+}
+
+constexpr char repeats_format[] PROGMEM = "last message repeated %u times\n";
+}  // namespace
+
+constexpr size_t BufferedLogger::header_size;
+constexpr size_t BufferedLogger::max_record_size;
+constexpr size_t BufferedLogger::max_payload_size;
+
 BufferedLogger&
 BufferedLogger::instance()
 {
@@ -8,35 +29,129 @@ BufferedLogger::instance()
 }
 
 BufferedLogger::BufferedLogger(uint16_t buf_size)
-  : buf_size_{buf_size}
+  : log_{buf_size}
 {
-    log_.reserve(buf_size);
 }
 
 size_t
 BufferedLogger::write(uint8_t c)
 {
-    log_ += c;
-    return (shrink() ? 0 : 1);
+    append_text(&c, 1);
+    return 1;
 }
 
 size_t
 BufferedLogger::write(uint8_t const* buffer, size_t size)
 {
-    auto shrinked = log_.concat((char const*)buffer, size);
-    return size - shrinked;
+    append_text(buffer, size);
+    return size;
+}
+
+uint32_t
+BufferedLogger::read_record(uint32_t offset, String& output) const
+{
+    uint8_t record[max_record_size];
+    size_t  size;
+    auto    next_offset = copy_record(offset, record, size);
+    render_record(record, size, output);
+    return next_offset;
 }
 
-String&
-BufferedLogger::get_log()
+uint32_t
+BufferedLogger::copy_record(uint32_t offset, uint8_t* data, size_t& size) const
 {
-    return log_;
+    uint16_t record_size;
+    log_.read(offset, reinterpret_cast<uint8_t*>(&record_size), sizeof(record_size));
+    size = record_size;
+    log_.read(offset, data, size);
+    return offset + size;
+}
+
+size_t
+BufferedLogger::render_record(uint8_t const* data, size_t size, String& output) const
+{
+    RecordHeader header;
+    if (size < header_size) {
+        return 0;
+    }
+    decode_header(data, header);
+    if ((header.size < header_size) || (header.size > size) || (header.type > RecordType::FORMAT) ||
+        (header.level >= LogLevel::NUM_OF_LEVELS) || (header.module >= LogModule::NUM_OF_MODULES)) {
+        return 0;
+    }
+
+    // Continuation of line goes without prefix
+    if (header.type != RecordType::TEXT_CONTINUATION) {
+        char prefix[32];
+        snprintf_P(prefix,
+                   sizeof(prefix),
+                   PSTR("[%u] %u.%06u %c "),
+                   header.sequence_number,
+                   header.timestamp / 1000000,
+                   header.timestamp % 1000000,
+                   toupper(pgm_read_byte(LogFilter::level_name(header.level))));
+        output += prefix;
+        output += FPSTR(LogFilter::module_name(header.module));
+        output += F(": ");
+    }
+
+    uint8_t const* payload      = data + header_size;
+    size_t         payload_size = header.size - header_size;
+    switch (header.type) {
+    case RecordType::TEXT:
+    case RecordType::TEXT_CONTINUATION:
+        output.concat(reinterpret_cast<char const*>(payload), payload_size);
+        break;
+    case RecordType::FORMAT:
+        render_format(payload, payload_size, output);
+        break;
+    }
+    return header.size;
+}
+
+uint32_t
+BufferedLogger::read_record_info(uint32_t offset, RecordInfo& info) const
+{
+    uint8_t      header_data[header_size];
+    RecordHeader header;
+    log_.read(offset, header_data, header_size);
+    decode_header(header_data, header);
+
+    info.level           = header.level;
+    info.module          = header.module;
+    info.is_continuation = (header.type == RecordType::TEXT_CONTINUATION);
+    return offset + header.size;
+}
+
+uint32_t
+BufferedLogger::begin_offset() const
+{
+    return log_.begin_offset();
+}
+
+uint32_t
+BufferedLogger::end_offset() const
+{
+    return is_text_record_open_ ? open_record_offset_ : log_.end_offset();
 }
 
 void
 BufferedLogger::clear()
 {
     log_.clear();
+    is_text_record_open_ = false;
+    is_line_open_        = false;
+    last_record_size_    = 0;
+    repeat_count_        = 0;
+}
+
+void
+BufferedLogger::flush_repeats()
+{
+    // Repeats are reported before the next record, so wait till the end of line, which is being printed
+    if ((repeat_count_ != 0) && !is_text_record_open_) {
+        write_repeats_record();
+    }
 }
 
 void
@@ -87,13 +202,248 @@ BufferedLogger::readString()
     return "";
 }
 
-size_t
-BufferedLogger::shrink()
+void
+BufferedLogger::pack(uint8_t* payload, size_t& size, char const* str)
+{
+    pack_string(payload, size, str, (str == nullptr) ? 0 : strlen(str));
+}
+
+void
+BufferedLogger::pack(uint8_t* payload, size_t& size, String const& str)
 {
-    if (log_.length() > buf_size_) {
-        size_t result = log_.length() - buf_size_;
-        log_          = log_.substring(result);
-        return result;
+    pack_string(payload, size, str.c_str(), str.length());
+}
+
+void
+BufferedLogger::pack_string(uint8_t* payload, size_t& size, char const* str, size_t length)
+{
+    if (size >= max_payload_size) {
+        return;
+    }
+    // Truncate string to make it fit in record
+    length              = std::min({length, size_t{UINT8_MAX}, max_payload_size - size - 1});
+    payload[size++]     = static_cast<uint8_t>(length);
+    memcpy(payload + size, str, length);
+    size += length;
+}
+
+void
+BufferedLogger::encode_header(RecordHeader const& header, uint8_t* data)
+{
+    memcpy(data, &header.size, sizeof(header.size));
+    data[2] = static_cast<uint8_t>(header.type);
+    data[3] = static_cast<uint8_t>((static_cast<uint8_t>(header.level) << 4) | static_cast<uint8_t>(header.module));
+    memcpy(data + 4, &header.sequence_number, sizeof(header.sequence_number));
+    memcpy(data + 8, &header.timestamp, sizeof(header.timestamp));
+}
+
+void
+BufferedLogger::decode_header(uint8_t const* data, RecordHeader& header)
+{
+    memcpy(&header.size, data, sizeof(header.size));
+    header.type   = static_cast<RecordType>(data[2]);
+    header.level  = static_cast<LogLevel>(data[3] >> 4);
+    header.module = static_cast<LogModule>(data[3] & 0x0F);
+    memcpy(&header.sequence_number, data + 4, sizeof(header.sequence_number));
+    memcpy(&header.timestamp, data + 8, sizeof(header.timestamp));
+}
+
+void
+BufferedLogger::append_text(uint8_t const* text, size_t size)
+{
+    while (size > 0) {
+        if (!is_text_record_open_) {
+            open_record_type_ = is_line_open_ ? RecordType::TEXT_CONTINUATION : RecordType::TEXT;
+            make_space(header_size);
+            open_record_offset_  = log_.end_offset();
+            open_record_size_    = header_size;
+            open_record_hash_    = fnv1a(fnv_offset_basis, reinterpret_cast<uint8_t const*>(&open_record_type_), 1);
+            is_text_record_open_ = true;
+            write_header(open_record_type_, LogLevel::INFO, LogModule::SYSTEM, open_record_size_);
+        }
+
+        // Every line goes to its own record
+        auto   end_of_line = static_cast<uint8_t const*>(memchr(text, '\n', size));
+        size_t chunk_size  = (end_of_line == nullptr) ? size : (end_of_line - text + 1);
+        chunk_size         = std::min(chunk_size, max_record_size - open_record_size_);
+        make_space(chunk_size);
+        if (!is_text_record_open_) {
+            // Open record was dropped to make space. Start new one
+            continue;
+        }
+
+        log_.write(text, chunk_size);
+        open_record_hash_ = fnv1a(open_record_hash_, text, chunk_size);
+        open_record_size_ += chunk_size;
+        log_.overwrite(open_record_offset_, reinterpret_cast<uint8_t const*>(&open_record_size_), sizeof(uint16_t));
+        is_line_open_ = (text[chunk_size - 1] != '\n');
+        if (!is_line_open_ || (open_record_size_ == max_record_size)) {
+            is_text_record_open_ = false;
+            // Only whole lines are compared
+            complete_text_record(!is_line_open_ && (open_record_type_ == RecordType::TEXT));
+        }
+        text += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+void
+BufferedLogger::complete_text_record(bool is_comparable)
+{
+    // Nobody could read the record, while it was open. So it still can be dropped or moved
+    if (is_comparable && (open_record_size_ == last_record_size_) && (open_record_hash_ == last_record_hash_) &&
+        (last_record_level_ == LogLevel::INFO) && (last_record_module_ == LogModule::SYSTEM) &&
+        (repeat_count_ < UINT16_MAX)) {
+        log_.truncate(open_record_size_);
+        --next_sequence_number_;
+        ++repeat_count_;
+        return;
+    }
+
+    if (repeat_count_ != 0) {
+        // Repeats should be reported before the new record
+        uint8_t      record[max_record_size];
+        RecordHeader header;
+        log_.read(open_record_offset_, record, open_record_size_);
+        log_.truncate(open_record_size_);
+        --next_sequence_number_;
+        write_repeats_record();
+
+        decode_header(record, header);
+        header.sequence_number = next_sequence_number_++;
+        encode_header(header, record);
+        make_space(open_record_size_);
+        log_.write(record, open_record_size_);
+    }
+
+    last_record_size_   = is_comparable ? open_record_size_ : 0;
+    last_record_hash_   = open_record_hash_;
+    last_record_level_  = LogLevel::INFO;
+    last_record_module_ = LogModule::SYSTEM;
+}
+
+void
+BufferedLogger::append_record(RecordType     type,
+                              LogLevel       level,
+                              LogModule      module,
+                              uint8_t const* payload,
+                              size_t         size)
+{
+    if (is_text_record_open_) {
+        // Line is interrupted by another record
+        is_text_record_open_ = false;
+        complete_text_record(false);
+    }
+    is_line_open_ = false;
+
+    size             = std::min(size, max_payload_size);
+    auto record_size = header_size + size;
+    auto hash        = fnv1a(fnv1a(fnv_offset_basis, reinterpret_cast<uint8_t const*>(&type), 1), payload, size);
+    if ((record_size == last_record_size_) && (hash == last_record_hash_) && (level == last_record_level_) &&
+        (module == last_record_module_) && (repeat_count_ < UINT16_MAX)) {
+        ++repeat_count_;
+        return;
+    }
+
+    if (repeat_count_ != 0) {
+        write_repeats_record();
+    }
+    write_record(type, level, module, payload, size);
+    last_record_size_   = record_size;
+    last_record_hash_   = hash;
+    last_record_level_  = level;
+    last_record_module_ = module;
+}
+
+void
+BufferedLogger::write_record(RecordType type, LogLevel level, LogModule module, uint8_t const* payload, size_t size)
+{
+    make_space(header_size + size);
+    write_header(type, level, module, header_size + size);
+    log_.write(payload, size);
+}
+
+void
+BufferedLogger::write_header(RecordType type, LogLevel level, LogModule module, uint16_t record_size)
+{
+    uint8_t data[header_size];
+    encode_header({record_size, type, level, module, next_sequence_number_++, static_cast<uint32_t>(micros())}, data);
+    log_.write(data, header_size);
+}
+
+void
+BufferedLogger::write_repeats_record()
+{
+    uint8_t payload[sizeof(PGM_P) + sizeof(uint32_t)];
+    size_t  size{sizeof(PGM_P)};
+    PGM_P   format = repeats_format;
+    memcpy(payload, &format, sizeof(format));
+    pack(payload, size, repeat_count_);
+    write_record(RecordType::FORMAT, last_record_level_, last_record_module_, payload, size);
+    repeat_count_ = 0;
+}
+
+void
+BufferedLogger::make_space(size_t size)
+{
+    while ((log_.free_space() < size) && (log_.size() > 0)) {
+        if (is_text_record_open_ && (open_record_offset_ == log_.begin_offset())) {
+            is_text_record_open_ = false;
+        }
+        uint16_t record_size;
+        log_.read(log_.begin_offset(), reinterpret_cast<uint8_t*>(&record_size), sizeof(record_size));
+        log_.discard(record_size);
+    }
+}
+
+void
+BufferedLogger::render_format(uint8_t const* payload, size_t size, String& output) const
+{
+    PGM_P format;
+    memcpy(&format, payload, sizeof(format));
+    size_t position{sizeof(format)};
+
+    char spec[16];
+    char buffer[24];
+    for (char c = pgm_read_byte(format); c != '\0'; c = pgm_read_byte(++format)) {
+        if (c != '%') {
+            output += c;
+            continue;
+        }
+
+        // Collect conversion specification: flags, width, precision, length modifier and conversion
+        size_t spec_size{0};
+        spec[spec_size++] = c;
+        do {
+            c = pgm_read_byte(++format);
+            if ((c == '\0') || (spec_size == sizeof(spec) - 1)) {
+                return;  // Malformed format string
+            }
+            spec[spec_size++] = c;
+        } while (strchr_P(PSTR("diouxXcsp%"), c) == nullptr);
+        spec[spec_size] = '\0';
+
+        if (c == '%') {
+            output += c;
+        }
+        else if (c == 's') {
+            if (position >= size) {
+                return;  // Missing argument
+            }
+            size_t length = payload[position++];
+            length        = std::min(length, size - position);
+            output.concat(reinterpret_cast<char const*>(payload + position), length);
+            position += length;
+        }
+        else {
+            uint32_t value;
+            if (position + sizeof(value) > size) {
+                return;  // Missing argument
+            }
+            memcpy(&value, payload + position, sizeof(value));
+            position += sizeof(value);
+            snprintf(buffer, sizeof(buffer), spec, value);
+            output += buffer;
+        }
     }
-    return 0;
 }
@@ -1,9 +1,26 @@
 #ifndef BUFFEREDLOGGER_H_
 #define BUFFEREDLOGGER_H_
 
+#include <type_traits>
+
+#include <Arduino.h>
 #include <Stream.h>
 #include <WString.h>
 
+#include "LogFilter.h"
+#include "RingBuffer.h"
+
+// Keeps the latest logs in preallocated ring buffer as records:
+//   [record length:2][type][level:4 bits, module:4 bits][sequence number:4][timestamp, us:4][payload]
+// TEXT record holds line of text, printed through Stream interface. Line is not available for reading until its end.
+// Line, which is longer than record, is continued in TEXT_CONTINUATION records. FORMAT record holds pointer to PROGMEM
+// format string and raw arguments: integers as 4 bytes, strings as [length][characters]. It is formatted only when logs
+// are read, so logging costs just a few copies of words.
+// Text, printed through Stream interface, is recorded with INFO level of SYSTEM module.
+// Timestamp is taken from micros(), so it wraps around every ~71 minutes.
+// Record, which is identical to the previous one, is not stored. Instead, "last message repeated N times" record is
+// added before the next different record or on flush_repeats().
+// When buffer is full, the oldest records are dropped as a whole.
 class BufferedLogger : public Stream
 {
 public:
@@ -14,11 +31,39 @@ public:
     BufferedLogger& operator=(BufferedLogger&) = delete;
     BufferedLogger& operator=(BufferedLogger&&) = delete;
 
+    struct RecordInfo
+    {
+        LogLevel  level;
+        LogModule module;
+        bool      is_continuation;  // Whether record continues line of the previous record
+    };
+    static constexpr size_t max_record_size{256};
+
     size_t write(uint8_t c) override;
     size_t write(uint8_t const* buffer, size_t size) override;
 
-    String& get_log();
-    void    clear();
+    // Store format string and arguments as FORMAT record. Supported arguments are integers (up to 32 bits), enums and
+    // strings (char const*, String). "ll" and floating-point conversions are not supported
+    template <typename... Args>
+    void printf_deferred(LogLevel level, LogModule module, PGM_P format, Args const&... args);
+
+    // Render record, starting at "offset", into text and append it to "output". Returns offset of the next record
+    uint32_t read_record(uint32_t offset, String& output) const;
+    // Copy raw record, starting at "offset", into "data" of max_record_size bytes. Returns offset of the next record
+    uint32_t copy_record(uint32_t offset, uint8_t* data, size_t& size) const;
+    // Render raw record, copied by copy_record() (possibly before reboot with the same firmware), into text and append
+    // it to "output". Returns size of the record or 0 if it is malformed
+    size_t render_record(uint8_t const* data, size_t size, String& output) const;
+    // Get level and module of record, starting at "offset", without rendering it. Returns offset of the next record
+    uint32_t read_record_info(uint32_t offset, RecordInfo& info) const;
+    // Offset of the oldest record
+    uint32_t begin_offset() const;
+    // Offset after the last complete record
+    uint32_t end_offset() const;
+    void     clear();
+
+    // Record "last message repeated N times" if there are repeated records, which are not reported yet
+    void flush_repeats();
 
     // Declare this function for compatibility with Serial
     void setDebugOutput(bool);
@@ -33,14 +78,81 @@ public:
     String readString() override;
 
 private:
+    enum class RecordType : uint8_t
+    {
+        TEXT = 0,
+        TEXT_CONTINUATION,
+        FORMAT
+    };
+    struct RecordHeader
+    {
+        uint16_t   size;
+        RecordType type;
+        LogLevel   level;
+        LogModule  module;
+        uint32_t   sequence_number;
+        uint32_t   timestamp;
+    };
+    static constexpr size_t header_size{12};
+    static constexpr size_t max_payload_size{max_record_size - header_size};
+
     explicit BufferedLogger(uint16_t buf_size = 2 * 1024);
 
-    // Reduce size of log string to make it fit in allocated buffer.
-    // Return amount of bytes, removed from buffer
-    size_t shrink();
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+    pack(uint8_t* payload, size_t& size, T value)
+    {
+        auto raw = static_cast<uint32_t>(value);
+        if (size + sizeof(raw) <= max_payload_size) {
+            memcpy(payload + size, &raw, sizeof(raw));
+            size += sizeof(raw);
+        }
+    }
+    static void pack(uint8_t* payload, size_t& size, char const* str);
+    static void pack(uint8_t* payload, size_t& size, String const& str);
+    static void pack_string(uint8_t* payload, size_t& size, char const* str, size_t length);
 
-    String   log_;
-    uint16_t buf_size_;
+    static void encode_header(RecordHeader const& header, uint8_t* data);
+    static void decode_header(uint8_t const* data, RecordHeader& header);
+
+    void append_text(uint8_t const* text, size_t size);
+    // Check if complete text record is repeated. If so, drop it
+    void complete_text_record(bool is_comparable);
+    void append_record(RecordType type, LogLevel level, LogModule module, uint8_t const* payload, size_t size);
+    void write_record(RecordType type, LogLevel level, LogModule module, uint8_t const* payload, size_t size);
+    void write_header(RecordType type, LogLevel level, LogModule module, uint16_t record_size);
+    void write_repeats_record();
+    // Drop the oldest records until there is "size" bytes of free space
+    void make_space(size_t size);
+    void render_format(uint8_t const* payload, size_t size, String& output) const;
+
+    RingBuffer log_;
+    bool       is_text_record_open_{false};  // Whether next printed text will be appended to the last record
+    bool       is_line_open_{false};         // Whether the last text record doesn't end with end of line
+    RecordType open_record_type_{RecordType::TEXT};
+    uint32_t   open_record_offset_{0};
+    uint16_t   open_record_size_{0};
+    uint32_t   open_record_hash_{0};
+    uint32_t   next_sequence_number_{0};
+
+    // The last complete record, used to detect repeated records
+    uint16_t  last_record_size_{0};  // 0 if there is no record to compare with
+    uint32_t  last_record_hash_{0};
+    LogLevel  last_record_level_{LogLevel::INFO};
+    LogModule last_record_module_{LogModule::SYSTEM};
+    uint16_t  repeat_count_{0};
 };
 
+template <typename... Args>
+void
+BufferedLogger::printf_deferred(LogLevel level, LogModule module, PGM_P format, Args const&... args)
+{
+    uint8_t payload[max_payload_size];
+    size_t  size{sizeof(format)};
+    memcpy(payload, &format, sizeof(format));
+    int expand[] = {0, (pack(payload, size, args), 0)...};
+    (void)expand;
+    append_record(RecordType::FORMAT, level, module, payload, size);
+}
+
 #endif  // BUFFEREDLOGGER_H_
@@ -2,6 +2,12 @@
 
 #include "logger.h"
 
+namespace
+{
+// Rendered logs are sent in messages of about this size
+constexpr size_t max_message_size{1024};
+}  // namespace
+
 DebugServer::DebugServer(WebSocketServer& web_socket_server)
   : web_socket_server_(web_socket_server)
 {
@@ -11,26 +17,63 @@ void
 DebugServer::init()
 {
     web_socket_server_.init();
-    web_socket_server_.set_handler(
-        WebSocketServer::Event::DISCONNECTED, [&](uint8_t client_id, String const& parameters) {
-            debugger_clients_ids_.erase(
-                std::remove(debugger_clients_ids_.begin(), debugger_clients_ids_.end(), client_id),
-                debugger_clients_ids_.end());
-        });
+    using RequestId = WebSocketServer::RequestId;
+    web_socket_server_.set_handler(WebSocketServer::Event::DISCONNECTED,
+                                   [&](uint8_t client_id, RequestId, String const& parameters) {
+                                       remove_subscriber(client_id);
+                                   });
     web_socket_server_.set_handler(WebSocketServer::Event::START_READING_LOGS,
-                                   [&](uint8_t client_id, String const& parameters) {
-                                       debugger_clients_ids_.push_back(client_id);
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       LogQuery query;
+                                       if (!query.parse(parameters)) {
+                                           web_socket_server_.send(client_id,
+                                                                   PSTR("ERROR: invalid log query \"") + parameters +
+                                                                       F("\""),
+                                                                   request_id);
+                                           return;
+                                       }
+
+                                       // Restart reading, if client is already subscribed
+                                       remove_subscriber(client_id);
+                                       subscribers_.push_back(
+                                           {client_id, BufferedLogger::instance().begin_offset(), query, false});
                                        send_buffered_logs();
                                    });
+    web_socket_server_.set_handler(WebSocketServer::Event::STOP_READING_LOGS,
+                                   [&](uint8_t client_id, RequestId, String const& parameters) {
+                                       send_buffered_logs();
+                                       remove_subscriber(client_id);
+                                   });
+
+    web_socket_server_.set_handler(WebSocketServer::Event::SEARCH_LOGS,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       LogQuery query;
+                                       if (!query.parse(parameters)) {
+                                           web_socket_server_.send(client_id,
+                                                                   PSTR("ERROR: invalid log query \"") + parameters +
+                                                                       F("\""),
+                                                                   request_id);
+                                           return;
+                                       }
+                                       search_logs(client_id, request_id, query);
+                                   });
+
+    web_socket_server_.set_handler(WebSocketServer::Event::GET_LOG_LEVELS,
+                                   [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+                                       send_log_levels(client_id, request_id);
+                                   });
     web_socket_server_.set_handler(
-        WebSocketServer::Event::STOP_READING_LOGS, [&](uint8_t client_id, String const& parameters) {
-            send_buffered_logs();
-            debugger_clients_ids_.erase(
-                std::remove(debugger_clients_ids_.begin(), debugger_clients_ids_.end(), client_id),
-                debugger_clients_ids_.end());
+        WebSocketServer::Event::SET_LOG_LEVELS, [&](uint8_t client_id, RequestId request_id, String const& parameters) {
+            if (!LogFilter::instance().configure(parameters)) {
+                web_socket_server_.send(
+                    client_id, PSTR("ERROR: invalid log levels \"") + parameters + F("\""), request_id);
+                return;
+            }
+            LOG_INFO(SYSTEM, PSTR("Log levels: %s\n"), LogFilter::instance().to_string().c_str());
+            send_log_levels(client_id, request_id);
         });
 
-    DEBUG_PRINTLN(F("Debug server initialized"));
+    LOG_INFO(SYSTEM, PSTR("Debug server initialized\n"));
 }
 
 void
@@ -39,6 +82,7 @@ DebugServer::loop()
     static unsigned long last_print{0};
     if (millis() - last_print > 1000) {
         // DEBUG_PRINT("+");  // TODO: just debug. Remove it in final version
+        BufferedLogger::instance().flush_repeats();
         send_buffered_logs();
         last_print = millis();
     }
@@ -49,11 +93,134 @@ DebugServer::loop()
 void
 DebugServer::send_buffered_logs()
 {
-    if (!debugger_clients_ids_.empty() && (BufferedLogger::instance().get_log().length() > 0)) {
-        auto& log = BufferedLogger::instance().get_log();
-        for (auto client_id : debugger_clients_ids_) {
-            web_socket_server_.send(client_id, log);
+    if (subscribers_.empty()) {
+        return;
+    }
+
+    // Logs are rendered into text only here, when somebody reads them
+    auto&  logger       = BufferedLogger::instance();
+    auto   begin_offset = logger.begin_offset();
+    auto   end_offset   = logger.end_offset();
+    String output;
+    output.reserve(max_message_size);
+    for (auto& subscriber : subscribers_) {
+        if (subscriber.cursor == end_offset) {
+            continue;
+        }
+
+        // Offsets wrap around, so compare them by distance from the end
+        if (end_offset - subscriber.cursor > end_offset - begin_offset) {
+            output += F("\n[");
+            output += begin_offset - subscriber.cursor;
+            output += F(" bytes lost]\n");
+            subscriber.cursor               = begin_offset;
+            subscriber.is_last_record_shown = false;
+        }
+
+        while (subscriber.cursor != end_offset) {
+            BufferedLogger::RecordInfo info;
+            auto                       next_offset = logger.read_record_info(subscriber.cursor, info);
+            subscriber.is_last_record_shown =
+                render_record(subscriber.cursor, info, subscriber.query, subscriber.is_last_record_shown, output);
+            subscriber.cursor = next_offset;
+            if (output.length() >= max_message_size) {
+                send_text(subscriber.client_id, output);
+                output.clear();
+            }
+        }
+        if (output.length() > 0) {
+            send_text(subscriber.client_id, output);
+            output.clear();
         }
-        BufferedLogger::instance().clear();
     }
+}
+
+void
+DebugServer::search_logs(uint8_t client_id, WebSocketServer::RequestId request_id, LogQuery const& query)
+{
+    // Report pending repeats too, so search result is the same as what readers see
+    auto& logger = BufferedLogger::instance();
+    logger.flush_repeats();
+
+    auto     end_offset = logger.end_offset();
+    uint32_t num_of_found_records{0};
+    bool     is_last_record_shown{false};
+    String   output;
+    output.reserve(max_message_size);
+    for (auto offset = logger.begin_offset(); offset != end_offset;) {
+        BufferedLogger::RecordInfo info;
+        auto                       next_offset = logger.read_record_info(offset, info);
+        is_last_record_shown                   = render_record(offset, info, query, is_last_record_shown, output);
+        if (is_last_record_shown && !info.is_continuation) {
+            ++num_of_found_records;
+        }
+        offset = next_offset;
+
+        // Results go in correlation envelope, so client can tell them from logs, which it reads at the same time
+        if (output.length() >= max_message_size) {
+            web_socket_server_.send(client_id, output, request_id);
+            output.clear();
+        }
+    }
+    if (output.length() > 0) {
+        web_socket_server_.send(client_id, output, request_id);
+    }
+    web_socket_server_.send(client_id, PSTR("DONE: ") + String(num_of_found_records) + F(" records found"), request_id);
+}
+
+bool
+DebugServer::render_record(uint32_t                          offset,
+                           BufferedLogger::RecordInfo const& info,
+                           LogQuery const&                   query,
+                           bool                              is_last_record_shown,
+                           String&                           output) const
+{
+    auto& logger = BufferedLogger::instance();
+    if (info.is_continuation) {
+        if (is_last_record_shown) {
+            logger.read_record(offset, output);
+        }
+        return is_last_record_shown;
+    }
+
+    if (!query.matches(info.level, info.module)) {
+        return false;
+    }
+    if (!query.has_text()) {
+        logger.read_record(offset, output);
+        return true;
+    }
+
+    // Substring is searched in rendered record, including its prefix
+    String record;
+    logger.read_record(offset, record);
+    if (!query.matches(record)) {
+        return false;
+    }
+    output += record;
+    return true;
+}
+
+void
+DebugServer::send_log_levels(uint8_t client_id, WebSocketServer::RequestId request_id)
+{
+    web_socket_server_.send(client_id, PSTR("LOG LEVELS: ") + LogFilter::instance().to_string(), request_id);
+}
+
+void
+DebugServer::send_text(uint8_t client_id, String const& text)
+{
+    // Send as binary, so non-printable characters in logs do not break WebSocket
+    web_socket_server_.send_binary(client_id, reinterpret_cast<uint8_t const*>(text.c_str()), text.length());
+}
+
+void
+DebugServer::remove_subscriber(uint8_t client_id)
+{
+    subscribers_.erase(std::remove_if(subscribers_.begin(),
+                                      subscribers_.end(),
+                                      [client_id](Subscriber const& subscriber) {
+                                          return subscriber.client_id == client_id;
+                                      }),
+                       subscribers_.end());
 }
\ No newline at end of file
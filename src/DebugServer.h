@@ -3,9 +3,17 @@
 
 #include <vector>
 
+#include "BufferedLogger.h"
+#include "LogQuery.h"
 #include "WebSocketServer.h"
 
-// Uses BufferedLogger singleton to get buffered logs and send them to all connected debugger clients
+// Uses BufferedLogger singleton to get buffered logs, render them into text and send them to all connected debugger
+// clients.
+// Every debugger client has its own read cursor in log. New client gets all retained history. If logs were overwritten
+// before client read them, client gets "N bytes lost" marker instead of them.
+// Client can pass LogQuery to "start_reading_logs" to get only matching records. Records are filtered here, on device,
+// so filtered out ones are not sent at all. "search_logs" request with the same query scans all retained history once
+// and replies with matching records and "DONE: N records found".
 class DebugServer
 {
 public:
@@ -14,10 +22,30 @@ public:
     void loop();
 
 private:
+    struct Subscriber
+    {
+        uint8_t  client_id;
+        uint32_t cursor;  // Offset of the next log record to be sent to client
+        LogQuery query;
+        bool     is_last_record_shown;  // Continuation of line is shown only if its beginning is shown
+    };
+
     void send_buffered_logs();
+    void search_logs(uint8_t client_id, WebSocketServer::RequestId request_id, LogQuery const& query);
+    // Render record, starting at "offset", and append it to "output" if it matches query. Returns whether record is
+    // shown
+    bool render_record(uint32_t                          offset,
+                       BufferedLogger::RecordInfo const& info,
+                       LogQuery const&                   query,
+                       bool                              is_last_record_shown,
+                       String&                           output) const;
+    void send_text(uint8_t client_id, String const& text);
+    // Reply with current levels of all log modules in LogFilter settings format
+    void send_log_levels(uint8_t client_id, WebSocketServer::RequestId request_id);
+    void remove_subscriber(uint8_t client_id);
 
-    WebSocketServer&     web_socket_server_;
-    std::vector<uint8_t> debugger_clients_ids_;
+    WebSocketServer&        web_socket_server_;
+    std::vector<Subscriber> subscribers_;
 };
 
 #endif  // DEBUGSERVER_H_
@@ -0,0 +1,368 @@
+#include "FsBatch.h"
+
+#include <FS.h>
+
+#include "FsIndex.h"
+#include "logger.h"
+
+namespace
+{
+constexpr size_t max_num_of_operations{64};
+
+constexpr char operation_create[] PROGMEM = "create";
+constexpr char operation_move[] PROGMEM   = "move";
+constexpr char operation_delete[] PROGMEM = "delete";
+
+constexpr char const* const operation_names[] PROGMEM = {operation_create, operation_move, operation_delete};
+
+void
+skip_whitespace(String const& json, size_t& position)
+{
+    while ((position < json.length()) && isspace(json[position])) {
+        ++position;
+    }
+}
+
+// Skip whitespace and expected character
+bool
+consume(String const& json, size_t& position, char expected)
+{
+    skip_whitespace(json, position);
+    if ((position >= json.length()) || (json[position] != expected)) {
+        return false;
+    }
+    ++position;
+    return true;
+}
+
+// Parse JSON string. Unicode escapes are supported only for ASCII characters
+bool
+parse_string(String const& json, size_t& position, String& output)
+{
+    if (!consume(json, position, '"')) {
+        return false;
+    }
+    output.clear();
+    while (position < json.length()) {
+        char c = json[position++];
+        if (c == '"') {
+            return true;
+        }
+        if (c != '\\') {
+            output += c;
+            continue;
+        }
+        if (position >= json.length()) {
+            return false;
+        }
+        c = json[position++];
+        switch (c) {
+        case 'n':
+            output += '\n';
+            break;
+        case 't':
+            output += '\t';
+            break;
+        case 'r':
+            output += '\r';
+            break;
+        case 'b':
+            output += '\b';
+            break;
+        case 'f':
+            output += '\f';
+            break;
+        case 'u': {
+            if (position + 4 > json.length()) {
+                return false;
+            }
+            auto code = strtoul(json.substring(position, position + 4).c_str(), nullptr, 16);
+            if ((code == 0) || (code > 0x7F)) {
+                return false;
+            }
+            output += static_cast<char>(code);
+            position += 4;
+            break;
+        }
+        case '"':
+        case '\\':
+        case '/':
+            output += c;
+            break;
+        default:
+            // Unknown escape
+            return false;
+        }
+    }
+    return false;
+}
+
+void
+render_string(String const& str, String& output)
+{
+    output += '"';
+    for (size_t i = 0; i < str.length(); ++i) {
+        if ((str[i] == '"') || (str[i] == '\\')) {
+            output += '\\';
+        }
+        output += str[i];
+    }
+    output += '"';
+}
+
+bool
+is_directory(String const& path)
+{
+    File file         = SPIFFS.open(path, "r");
+    auto is_directory = file && file.isDirectory();
+    file.close();
+    return is_directory;
+}
+
+}  // namespace
+
+bool
+FsBatch::parse(String const& json)
+{
+    operations_.clear();
+    results_.clear();
+    next_operation_ = 0;
+    next_result_    = 0;
+    pending_output_ = '[';
+    is_rendered_    = false;
+
+    size_t position{0};
+    if (!consume(json, position, '[')) {
+        return false;
+    }
+    skip_whitespace(json, position);
+    auto is_empty = (position < json.length()) && (json[position] == ']');
+    while (!is_empty) {
+        if (!consume(json, position, '{')) {
+            return false;
+        }
+        String    type;
+        Operation operation{OperationType::CREATE, String{}, String{}};
+        bool      is_last_field{false};
+        while (!is_last_field) {
+            String key;
+            String value;
+            if (!parse_string(json, position, key) || !consume(json, position, ':') ||
+                !parse_string(json, position, value)) {
+                return false;
+            }
+            if (key == F("op")) {
+                type = value;
+            }
+            else if (key == F("path")) {
+                operation.path = value;
+            }
+            else if (key == F("src")) {
+                operation.src = value;
+            }
+            is_last_field = !consume(json, position, ',');
+        }
+        if (!consume(json, position, '}')) {
+            return false;
+        }
+
+        if (type == FPSTR(operation_create)) {
+            operation.type = OperationType::CREATE;
+        }
+        else if (type == FPSTR(operation_move)) {
+            operation.type = OperationType::MOVE;
+        }
+        else if (type == FPSTR(operation_delete)) {
+            operation.type = OperationType::DELETE;
+        }
+        else {
+            return false;
+        }
+        if (operations_.size() == max_num_of_operations) {
+            return false;
+        }
+        operations_.push_back(std::move(operation));
+
+        if (!consume(json, position, ',')) {
+            break;
+        }
+    }
+    return consume(json, position, ']');
+}
+
+size_t
+FsBatch::num_of_operations() const
+{
+    return operations_.size();
+}
+
+bool
+FsBatch::run_next()
+{
+    if (next_operation_ >= operations_.size()) {
+        return false;
+    }
+    if (next_operation_ == 0) {
+        results_.reserve(operations_.size());
+    }
+
+    auto const& operation = operations_[next_operation_++];
+    auto        error     = run_operation(operation);
+    LOG_INFO(FS,
+             PSTR("Batch: %s %s%s%s: %s\n"),
+             String{FPSTR(pgm_read_ptr(&operation_names[static_cast<uint8_t>(operation.type)]))}.c_str(),
+             operation.src.c_str(),
+             operation.src.isEmpty() ? "" : " -> ",
+             operation.path.c_str(),
+             (error != nullptr) ? String{FPSTR(error)}.c_str() : "OK");
+    results_.push_back(error);
+    return next_operation_ < operations_.size();
+}
+
+size_t
+FsBatch::fill(uint8_t* buffer, size_t max_size)
+{
+    // Results are rendered one per call, so only a small part of reply is kept in RAM
+    if ((pending_output_.length() < max_size) && !is_rendered_) {
+        if (next_result_ < results_.size()) {
+            render_result(operations_[next_result_], results_[next_result_]);
+            ++next_result_;
+        }
+        if (next_result_ == results_.size()) {
+            pending_output_ += ']';
+            is_rendered_ = true;
+        }
+    }
+
+    auto size = std::min(max_size, static_cast<size_t>(pending_output_.length()));
+    memcpy(buffer, pending_output_.c_str(), size);
+    pending_output_.remove(0, size);
+    return size;
+}
+
+void
+FsBatch::delete_tree(String const& path)
+{
+    // Folder is pushed to stack twice: first time to push its content, second time to remove it, when it is empty
+    struct Node
+    {
+        String path;
+        bool   is_listed;
+    };
+    std::vector<Node> stack{{path, false}};
+    while (!stack.empty()) {
+        auto node = std::move(stack.back());
+        stack.pop_back();
+        if (node.is_listed) {
+            SPIFFS.rmdir(node.path);
+            continue;
+        }
+        if (!is_directory(node.path)) {
+            if (SPIFFS.remove(node.path)) {
+                FsIndex::instance().remove(node.path);
+            }
+            continue;
+        }
+
+        stack.push_back({node.path, true});
+        Dir dir = SPIFFS.openDir(node.path);
+        while (dir.next()) {
+            stack.push_back({node.path + '/' + dir.fileName(), false});
+        }
+    }
+}
+
+void
+FsBatch::remove_variants(String const& path)
+{
+    for (auto suffix : {F(".gz"), F(".br")}) {
+        String variant_path{path + suffix};
+        if (SPIFFS.remove(variant_path)) {
+            FsIndex::instance().remove(variant_path);
+        }
+    }
+}
+
+PGM_P
+FsBatch::run_operation(Operation const& operation)
+{
+    String path{operation.path};
+    if (!path.startsWith("/") || (path.indexOf("//") != -1) || (path == "/")) {
+        return PSTR("BAD PATH");
+    }
+
+    switch (operation.type) {
+    case OperationType::CREATE:
+        if (SPIFFS.exists(path)) {
+            return PSTR("FILE EXISTS");
+        }
+        if (path.endsWith("/")) {
+            path.remove(path.length() - 1);
+            return SPIFFS.mkdir(path) ? nullptr : PSTR("MKDIR FAILED");
+        }
+        else {
+            File file = SPIFFS.open(path, "w");
+            if (!file) {
+                return PSTR("CREATE FAILED");
+            }
+            file.close();
+            FsIndex::instance().update(path);
+            remove_variants(path);
+            return nullptr;
+        }
+
+    case OperationType::MOVE: {
+        String src{operation.src};
+        if (!src.startsWith("/") || (src == "/")) {
+            return PSTR("BAD SRC");
+        }
+        if (SPIFFS.exists(path)) {
+            return PSTR("FILE EXISTS");
+        }
+        if (!SPIFFS.exists(src)) {
+            return PSTR("SRC FILE NOT FOUND");
+        }
+        if (path.endsWith("/")) {
+            path.remove(path.length() - 1);
+        }
+        if (src.endsWith("/")) {
+            src.remove(src.length() - 1);
+        }
+        if (!SPIFFS.rename(src, path)) {
+            return PSTR("RENAME FAILED");
+        }
+        FsIndex::instance().rename(src, path);
+        remove_variants(src);
+        remove_variants(path);
+        return nullptr;
+    }
+
+    case OperationType::DELETE:
+        if (!SPIFFS.exists(path)) {
+            return PSTR("NOT FOUND");
+        }
+        delete_tree(path);
+        remove_variants(path);
+        return nullptr;
+    }
+    return nullptr;
+}
+
+void
+FsBatch::render_result(Operation const& operation, PGM_P error)
+{
+    if (next_result_ > 0) {
+        pending_output_ += ',';
+    }
+    pending_output_ += F("{\"op\":\"");
+    pending_output_ += FPSTR(pgm_read_ptr(&operation_names[static_cast<uint8_t>(operation.type)]));
+    pending_output_ += F("\",\"path\":");
+    render_string(operation.path, pending_output_);
+    if (!operation.src.isEmpty()) {
+        pending_output_ += F(",\"src\":");
+        render_string(operation.src, pending_output_);
+    }
+    pending_output_ += F(",\"result\":\"");
+    pending_output_ += (error != nullptr) ? FPSTR(error) : F("OK");
+    pending_output_ += F("\"}");
+}
@@ -0,0 +1,60 @@
+#ifndef FSBATCH_H_
+#define FSBATCH_H_
+
+#include <vector>
+
+#include <Arduino.h>
+#include <WString.h>
+
+// List of file system operations, received in one request. Request is JSON array of operations:
+//   [{"op":"create","path":"/new_file"}, {"op":"create","path":"/new_folder/"},
+//    {"op":"move","src":"/old_name","path":"/new_name"}, {"op":"delete","path":"/file_or_folder"}]
+// Operations are run one by one from WebServer::loop(), so long batch doesn't block web server. They are run even if
+// client disconnects. Only results are rendered, while reply is sent:
+//   [{"op":"create","path":"/new_file","result":"OK"}, {"op":"delete","path":"/file_or_folder","result":"NOT FOUND"}]
+// Failed operation doesn't stop the batch. FsIndex is updated after every operation.
+class FsBatch
+{
+public:
+    // Returns false if request is not valid JSON array of operations
+    bool   parse(String const& json);
+    size_t num_of_operations() const;
+    // Run the next operation. Returns false when all operations are done
+    bool   run_next();
+    // Render results of operations into "buffer". Returns 0 when all results are rendered
+    size_t fill(uint8_t* buffer, size_t max_size);
+
+    // Delete file or folder with all its content and remove deleted files from FsIndex. Folders are walked with
+    // explicit stack instead of recursion, so deeply nested folders can not overflow stack
+    static void delete_tree(String const& path);
+    // Remove precompressed variants of file ("<path>.gz", "<path>.br") from SPIFFS and FsIndex. Web server prefers
+    // them to original file, so they should not outlive change of the original
+    static void remove_variants(String const& path);
+
+private:
+    enum class OperationType : uint8_t
+    {
+        CREATE = 0,
+        MOVE,
+        DELETE
+    };
+    struct Operation
+    {
+        OperationType type;
+        String        path;
+        String        src;
+    };
+
+    // Returns nullptr on success or PROGMEM description of error
+    static PGM_P run_operation(Operation const& operation);
+    void         render_result(Operation const& operation, PGM_P error);
+
+    std::vector<Operation> operations_;
+    std::vector<PGM_P>     results_;  // nullptr on success or PROGMEM description of error
+    size_t                 next_operation_{0};
+    size_t                 next_result_{0};
+    String                 pending_output_;  // Rendered, but not sent yet
+    bool                   is_rendered_{false};
+};
+
+#endif  // FSBATCH_H_
@@ -0,0 +1,235 @@
+#include "FsIndex.h"
+
+#include <algorithm>
+
+#include <FS.h>
+
+#include "logger.h"
+
+namespace
+{
+constexpr uint32_t      fnv_offset_basis{2166136261u};
+constexpr uint32_t      fnv_prime{16777619u};
+constexpr unsigned long check_period{2000};  // Period of checking file system for changes, done behind index, ms
+constexpr size_t        read_chunk_size{256};
+
+uint32_t
+fnv1a(uint32_t hash, uint8_t const* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * fnv_prime;
+    }
+    return hash;
+}
+}  // namespace
+
+constexpr uint32_t FsIndex::empty_content_hash;
+
+FsIndex&
+FsIndex::instance()
+{
+    static FsIndex fs_index;
+    return fs_index;
+}
+
+void
+FsIndex::init()
+{
+    rebuild();
+    LOG_INFO(FS, PSTR("File system index initialized: %u files\n"), entries_.size());
+}
+
+void
+FsIndex::loop()
+{
+    if (millis() - last_check_time_ < check_period) {
+        return;
+    }
+    last_check_time_ = millis();
+
+    FSInfo fs_info;
+    if (SPIFFS.info(fs_info) && (fs_info.usedBytes != used_bytes_)) {
+        LOG_INFO(FS, PSTR("File system is changed outside of index. Rebuilding it\n"));
+        rebuild();
+    }
+}
+
+bool
+FsIndex::exists(String const& path) const
+{
+    Entry entry;
+    return find(path, entry);
+}
+
+bool
+FsIndex::find(String const& path, Entry& entry) const
+{
+    auto it = find_entry(path, hash_path(path));
+    if (it == entries_.end()) {
+        return false;
+    }
+    entry = *it;
+    return true;
+}
+
+bool
+FsIndex::has_gz_variant(String const& path) const
+{
+    return exists(path + F(".gz"));
+}
+
+uint32_t
+FsIndex::content_hash(String const& path)
+{
+    auto it = find_entry(path, hash_path(path));
+    if (it == entries_.end()) {
+        return 0;
+    }
+    if (it->content_hash != 0) {
+        return it->content_hash;
+    }
+
+    File file = SPIFFS.open(path, "r");
+    if (!file) {
+        entries_.erase(it);
+        return 0;
+    }
+    uint8_t  buffer[read_chunk_size];
+    uint32_t hash{empty_content_hash};
+    while (file.available()) {
+        auto size = file.read(buffer, sizeof(buffer));
+        hash      = hash_content(hash, buffer, size);
+    }
+    file.close();
+
+    // 0 means "not calculated"
+    it->content_hash = (hash != 0) ? hash : 1;
+    return it->content_hash;
+}
+
+void
+FsIndex::update(String const& path, uint32_t content_hash)
+{
+    auto path_hash = hash_path(path);
+    auto it        = find_entry(path, path_hash);
+    bool is_found  = (it != entries_.end());
+
+    File file = SPIFFS.open(path, "r");
+    if (!file) {
+        if (is_found) {
+            entries_.erase(it);
+        }
+        update_used_bytes();
+        return;
+    }
+    Entry entry{path_hash, static_cast<uint32_t>(file.size()), content_hash, path};
+    file.close();
+
+    if (is_found) {
+        *it = entry;
+    }
+    else {
+        entries_.insert(lower_bound(path_hash), entry);
+    }
+    update_used_bytes();
+}
+
+void
+FsIndex::invalidate_content_hashes()
+{
+    for (auto& entry : entries_) {
+        entry.content_hash = 0;
+    }
+}
+
+void
+FsIndex::remove(String const& path)
+{
+    auto it = find_entry(path, hash_path(path));
+    if (it != entries_.end()) {
+        entries_.erase(it);
+    }
+    update_used_bytes();
+}
+
+void
+FsIndex::rename(String const& from, String const& to)
+{
+    remove(from);
+    update(to);
+}
+
+void
+FsIndex::rebuild()
+{
+    entries_.clear();
+    Dir dir = SPIFFS.openDir("/");
+    while (dir.next()) {
+        auto path = dir.fileName();
+        entries_.push_back({hash_path(path), static_cast<uint32_t>(dir.fileSize()), 0, path});
+    }
+    std::sort(entries_.begin(), entries_.end(), [](Entry const& l, Entry const& r) {
+        return l.path_hash < r.path_hash;
+    });
+    entries_.shrink_to_fit();
+    update_used_bytes();
+}
+
+uint32_t
+FsIndex::hash_content(uint32_t hash, uint8_t const* data, size_t size)
+{
+    return fnv1a(hash, data, size);
+}
+
+uint32_t
+FsIndex::hash_path(String const& path)
+{
+    return fnv1a(fnv_offset_basis, reinterpret_cast<uint8_t const*>(path.c_str()), path.length());
+}
+
+std::vector<FsIndex::Entry>::iterator
+FsIndex::lower_bound(uint32_t path_hash)
+{
+    return std::lower_bound(entries_.begin(), entries_.end(), path_hash, [](Entry const& entry, uint32_t hash) {
+        return entry.path_hash < hash;
+    });
+}
+
+std::vector<FsIndex::Entry>::const_iterator
+FsIndex::lower_bound(uint32_t path_hash) const
+{
+    return std::lower_bound(entries_.begin(), entries_.end(), path_hash, [](Entry const& entry, uint32_t hash) {
+        return entry.path_hash < hash;
+    });
+}
+
+std::vector<FsIndex::Entry>::iterator
+FsIndex::find_entry(String const& path, uint32_t path_hash)
+{
+    for (auto it = lower_bound(path_hash); (it != entries_.end()) && (it->path_hash == path_hash); ++it) {
+        if (it->path == path) {
+            return it;
+        }
+    }
+    return entries_.end();
+}
+
+std::vector<FsIndex::Entry>::const_iterator
+FsIndex::find_entry(String const& path, uint32_t path_hash) const
+{
+    for (auto it = lower_bound(path_hash); (it != entries_.end()) && (it->path_hash == path_hash); ++it) {
+        if (it->path == path) {
+            return it;
+        }
+    }
+    return entries_.end();
+}
+
+void
+FsIndex::update_used_bytes()
+{
+    FSInfo fs_info;
+    if (SPIFFS.info(fs_info)) {
+        used_bytes_ = fs_info.usedBytes;
+    }
+}
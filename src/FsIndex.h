@@ -0,0 +1,78 @@
+#ifndef FSINDEX_H_
+#define FSINDEX_H_
+
+#include <vector>
+
+#include <Arduino.h>
+#include <WString.h>
+
+// In-RAM index of files on SPIFFS. Every lookup in SPIFFS (exists(), open()) scans object headers in flash, so web
+// server would scan flash several times for every request. Instead, metadata of all files is collected once at boot
+// into vector of entries, sorted by hash of path, and lookups are done with binary search, without touching flash.
+// Different paths can have the same hash, so entry keeps its path, which is compared on match of hash.
+// Index should be notified about every change of file system, done by firmware. Changes, done by FTP server, can not
+// be tracked this way, so loop() detects them by change of used space and rebuilds index. Overwrite of file with
+// content of the same size doesn't change used space, so cached hashes of content should be invalidated, when FTP
+// client connects and disconnects.
+class FsIndex
+{
+public:
+    struct Entry
+    {
+        uint32_t path_hash;
+        uint32_t size;
+        uint32_t content_hash;  // Hash of file content. 0 if it is not calculated yet
+        String   path;
+    };
+
+    // Singleton
+    static FsIndex& instance();
+    FsIndex(FsIndex&)  = delete;
+    FsIndex(FsIndex&&) = delete;
+    FsIndex& operator=(FsIndex&) = delete;
+    FsIndex& operator=(FsIndex&&) = delete;
+
+    // Should be called after SPIFFS is mounted
+    void init();
+    void loop();
+
+    bool exists(String const& path) const;
+    bool find(String const& path, Entry& entry) const;
+    // Whether gzip-compressed version of file ("<path>.gz") exists
+    bool has_gz_variant(String const& path) const;
+    // Hash of file content is calculated on the first request and cached until file is changed. Returns 0 if there is
+    // no such file
+    uint32_t content_hash(String const& path);
+
+    // Re-read metadata of file after it was created or written. If file doesn't exist anymore, it is removed from index
+    // Hash of content can be passed if it is calculated while file is written, so file is not read again
+    void update(String const& path, uint32_t content_hash = 0);
+    // Forget cached hashes of content of all files. They will be calculated again on the next request
+    void invalidate_content_hashes();
+
+    // Hash of content can be calculated incrementally, starting with empty_content_hash
+    static constexpr uint32_t empty_content_hash{2166136261u};
+    static uint32_t           hash_content(uint32_t hash, uint8_t const* data, size_t size);
+    void remove(String const& path);
+    void rename(String const& from, String const& to);
+    void rebuild();
+
+private:
+    FsIndex() = default;
+
+    static uint32_t hash_path(String const& path);
+
+    std::vector<Entry>::iterator       lower_bound(uint32_t path_hash);
+    std::vector<Entry>::const_iterator lower_bound(uint32_t path_hash) const;
+    // Entry of exactly this path among entries with the same hash. Returns end() if there is no such entry
+    std::vector<Entry>::iterator       find_entry(String const& path, uint32_t path_hash);
+    std::vector<Entry>::const_iterator find_entry(String const& path, uint32_t path_hash) const;
+    // Remember used space of file system, so changes, done behind index, can be detected
+    void update_used_bytes();
+
+    std::vector<Entry> entries_;  // Sorted by path hash
+    size_t             used_bytes_{0};
+    unsigned long      last_check_time_{0};
+};
+
+#endif  // FSINDEX_H_
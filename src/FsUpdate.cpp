@@ -0,0 +1,278 @@
+#include "FsUpdate.h"
+
+#include <algorithm>
+
+#include <FS.h>
+
+#include "FsIndex.h"
+#include "logger.h"
+
+namespace
+{
+constexpr char   temp_prefix[] PROGMEM  = "/~fsu";
+constexpr char   journal_path[] PROGMEM = "/~fsu.journal";
+constexpr char   journal_end[] PROGMEM  = "END";  // The last line of complete journal
+constexpr size_t max_manifest_size{4 * 1024};
+constexpr size_t content_hash_length{8};
+
+bool
+parse_hash(String const& str, uint32_t& hash)
+{
+    if (str.length() != content_hash_length) {
+        return false;
+    }
+    for (size_t i = 0; i < str.length(); ++i) {
+        if (!isxdigit(str[i])) {
+            return false;
+        }
+    }
+    hash = strtoul(str.c_str(), nullptr, 16);
+    return true;
+}
+
+}  // namespace
+
+void
+FsUpdate::init()
+{
+    replay_journal();
+
+    // Temporary files of update, which was not committed before reboot
+    std::vector<String> temp_files;
+    Dir                 dir = SPIFFS.openDir(FPSTR(temp_prefix));
+    while (dir.next()) {
+        temp_files.push_back(dir.fileName());
+    }
+    for (auto const& path : temp_files) {
+        LOG_INFO(FS, PSTR("FS update: removing %s\n"), path.c_str());
+        SPIFFS.remove(path);
+        FsIndex::instance().remove(path);
+    }
+}
+
+void
+FsUpdate::begin()
+{
+    abort();
+    error_ = nullptr;
+}
+
+bool
+FsUpdate::add_manifest(uint8_t const* data, size_t size)
+{
+    if (manifest_.length() + size > max_manifest_size) {
+        fail(PSTR("ERROR: manifest is too big"));
+        return false;
+    }
+    manifest_.concat(reinterpret_cast<char const*>(data), size);
+    return true;
+}
+
+bool
+FsUpdate::end_manifest()
+{
+    String manifest{std::move(manifest_)};
+    manifest_ = String{};
+    files_.clear();
+
+    int start = 0;
+    while (start < static_cast<int>(manifest.length())) {
+        auto end = manifest.indexOf('\n', start);
+        if (end < 0) {
+            end = manifest.length();
+        }
+        String line{manifest.substring(start, end)};
+        start = end + 1;
+        line.trim();
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        auto     separator = line.indexOf(' ');
+        uint32_t content_hash{0};
+        String   path{line.substring(content_hash_length + 1)};
+        if ((separator != static_cast<int>(content_hash_length)) ||
+            !parse_hash(line.substring(0, content_hash_length), content_hash) || !path.startsWith("/") ||
+            path.startsWith(FPSTR(temp_prefix))) {
+            fail(PSTR("ERROR: invalid manifest"));
+            files_.clear();
+            return false;
+        }
+        if (FsIndex::instance().content_hash(path) != content_hash) {
+            files_.push_back({path, content_hash, false});
+        }
+    }
+
+    LOG_INFO(FS, PSTR("FS update: %u files should be updated\n"), files_.size());
+    return true;
+}
+
+std::vector<String>
+FsUpdate::missing_files() const
+{
+    std::vector<String> result;
+    for (auto const& file : files_) {
+        if (!file.is_uploaded) {
+            result.push_back(file.path);
+        }
+    }
+    return result;
+}
+
+bool
+FsUpdate::write_file(String const& path, uint8_t const* data, size_t size, size_t index, size_t total)
+{
+    auto it = std::find_if(
+        files_.begin(), files_.end(), [&path](ChangedFile const& file) { return file.path == path; });
+    if (it == files_.end()) {
+        fail(PSTR("ERROR: file is not in manifest"));
+        return false;
+    }
+    size_t file_index = it - files_.begin();
+
+    if (index == 0) {
+        // File can be uploaded again, if previous attempt failed
+        it->is_uploaded = false;
+        writer_.reset(new UploadWriter);
+        writer_file_index_ = file_index;
+        if (!writer_->open(temp_path(file_index))) {
+            writer_.reset();
+            fail(PSTR("ERROR: can not create file"));
+            return false;
+        }
+    }
+    if (!writer_ || (writer_file_index_ != file_index)) {
+        fail(PSTR("ERROR: upload of file is not started"));
+        return false;
+    }
+
+    auto is_written = writer_->write(data, size);
+    if (is_written && (index + size < total)) {
+        return true;
+    }
+
+    is_written = writer_->close() && is_written;
+    // 0 means "not calculated" in FsIndex
+    auto content_hash = (writer_->content_hash() != 0) ? writer_->content_hash() : 1;
+    FsIndex::instance().update(writer_->path(), is_written ? content_hash : 0);
+    writer_.reset();
+    if (!is_written) {
+        fail(PSTR("ERROR: can not write file"));
+        return false;
+    }
+    if (content_hash != it->content_hash) {
+        fail(PSTR("ERROR: content of file doesn't match manifest"));
+        return false;
+    }
+    it->is_uploaded = true;
+    LOG_DEBUG(FS, PSTR("FS update: %s is uploaded\n"), path.c_str());
+    return true;
+}
+
+int
+FsUpdate::commit()
+{
+    auto is_uploaded = [](ChangedFile const& file) { return file.is_uploaded; };
+    if (writer_ || !std::all_of(files_.begin(), files_.end(), is_uploaded)) {
+        fail(PSTR("ERROR: not all files are uploaded"));
+        return -1;
+    }
+
+    // Journal is valid only if it is written completely, otherwise update is not committed
+    ::File journal = SPIFFS.open(FPSTR(journal_path), "w");
+    if (!journal) {
+        fail(PSTR("ERROR: can not create journal"));
+        return -1;
+    }
+    size_t expected_size{0};
+    size_t written_size{0};
+    for (size_t i = 0; i < files_.size(); ++i) {
+        String line{temp_path(i) + ' ' + files_[i].path + '\n'};
+        expected_size += line.length();
+        written_size += journal.print(line);
+    }
+    String end_line{String{FPSTR(journal_end)} + '\n'};
+    expected_size += end_line.length();
+    written_size += journal.print(end_line);
+    journal.close();
+    if (written_size != expected_size) {
+        SPIFFS.remove(FPSTR(journal_path));
+        fail(PSTR("ERROR: can not write journal"));
+        return -1;
+    }
+
+    replay_journal();
+    int num_of_files = files_.size();
+    files_.clear();
+    LOG_INFO(FS, PSTR("FS update: %d files are updated\n"), num_of_files);
+    return num_of_files;
+}
+
+void
+FsUpdate::abort()
+{
+    writer_.reset();
+    for (size_t i = 0; i < files_.size(); ++i) {
+        auto path = temp_path(i);
+        if (FsIndex::instance().exists(path)) {
+            SPIFFS.remove(path);
+            FsIndex::instance().remove(path);
+        }
+    }
+    files_.clear();
+    manifest_ = String{};
+}
+
+PGM_P
+FsUpdate::error() const
+{
+    return error_;
+}
+
+String
+FsUpdate::temp_path(size_t file_index)
+{
+    return String{FPSTR(temp_prefix)} + file_index;
+}
+
+void
+FsUpdate::replay_journal()
+{
+    ::File journal = SPIFFS.open(FPSTR(journal_path), "r");
+    if (!journal) {
+        return;
+    }
+    String content{journal.readString()};
+    journal.close();
+
+    // Journal, which is not complete, means that commit was not started
+    String end_line{String{FPSTR(journal_end)} + '\n'};
+    if ((content == end_line) || content.endsWith(String{'\n'} + end_line)) {
+        int start = 0;
+        while (start < static_cast<int>(content.length())) {
+            auto   end = content.indexOf('\n', start);
+            String line{content.substring(start, end)};
+            start          = end + 1;
+            auto separator = line.indexOf(' ');
+            if (separator < 0) {
+                continue;
+            }
+            // Rename can be already done before reboot
+            String from{line.substring(0, separator)};
+            String to{line.substring(separator + 1)};
+            if (SPIFFS.exists(from)) {
+                SPIFFS.remove(to);
+                SPIFFS.rename(from, to);
+                FsIndex::instance().rename(from, to);
+            }
+        }
+    }
+    SPIFFS.remove(FPSTR(journal_path));
+}
+
+void
+FsUpdate::fail(PGM_P error)
+{
+    LOG_ERROR(FS, PSTR("FS update: %s\n"), String{FPSTR(error)}.c_str());
+    error_ = error;
+}
@@ -0,0 +1,64 @@
+#ifndef FSUPDATE_H_
+#define FSUPDATE_H_
+
+#include <memory>
+#include <vector>
+
+#include <Arduino.h>
+#include <WString.h>
+
+#include "UploadWriter.h"
+
+// Update of set of files on SPIFFS as a whole, ex. new version of web UI. Client sends manifest with hash of content of
+// every file. Only files, which differ from manifest, are requested from client. They are uploaded to temporary files
+// and checked against manifest. On commit() temporary files replace original ones, so either all files are updated
+// or none of them.
+// SPIFFS can not replace several files at once, so list of renames is written to journal before files are replaced.
+// If ESP is rebooted in the middle of commit, init() completes renames from journal. Temporary files of update, which
+// is not committed, are removed.
+class FsUpdate
+{
+public:
+    // Should be called after SPIFFS is mounted
+    void init();
+
+    // Manifest is text with line "<content hash, 8 hex digits> <path>" per file. Hash is FNV-1a of file content, as in
+    // FsIndex. Manifest can be received in several pieces
+    void begin();
+    bool add_manifest(uint8_t const* data, size_t size);
+    // Parse received manifest and find files, which should be uploaded
+    bool end_manifest();
+    // Paths of files, which are not uploaded yet
+    std::vector<String> missing_files() const;
+
+    // Write piece of file, listed in manifest. "index" is offset of piece in file, "total" is size of file
+    bool write_file(String const& path, uint8_t const* data, size_t size, size_t index, size_t total);
+    // Replace original files by uploaded ones. Returns number of replaced files or -1 on error. SPIFFS should have
+    // space for temporary files, until they replace original ones
+    int  commit();
+    void abort();
+
+    // Description of the last error, PROGMEM string
+    PGM_P error() const;
+
+private:
+    struct ChangedFile
+    {
+        String   path;
+        uint32_t content_hash;
+        bool     is_uploaded;
+    };
+
+    static String temp_path(size_t file_index);
+    // Complete renames from journal, if commit was interrupted
+    static void replay_journal();
+    void        fail(PGM_P error);
+
+    String                        manifest_;
+    std::vector<ChangedFile>      files_;  // Files, which differ from manifest
+    std::unique_ptr<UploadWriter> writer_;
+    size_t                        writer_file_index_{0};
+    PGM_P                         error_{nullptr};
+};
+
+#endif  // FSUPDATE_H_
@@ -0,0 +1,143 @@
+#include "LogFilter.h"
+
+namespace
+{
+constexpr char module_system[] PROGMEM  = "system";
+constexpr char module_web[] PROGMEM     = "web";
+constexpr char module_ws[] PROGMEM      = "ws";
+constexpr char module_arduino[] PROGMEM = "arduino";
+constexpr char module_stk500[] PROGMEM  = "stk500";
+constexpr char module_fs[] PROGMEM      = "fs";
+
+constexpr char const* const module_names[] PROGMEM = {
+    module_system, module_web, module_ws, module_arduino, module_stk500, module_fs};
+static_assert(sizeof(module_names) / sizeof(module_names[0]) == static_cast<size_t>(LogModule::NUM_OF_MODULES),
+              "Names of all log modules should be defined");
+
+constexpr char level_error[] PROGMEM   = "error";
+constexpr char level_warning[] PROGMEM = "warning";
+constexpr char level_info[] PROGMEM    = "info";
+constexpr char level_debug[] PROGMEM   = "debug";
+constexpr char level_trace[] PROGMEM   = "trace";
+
+constexpr char const* const level_names[] PROGMEM = {level_error, level_warning, level_info, level_debug, level_trace};
+static_assert(sizeof(level_names) / sizeof(level_names[0]) == static_cast<size_t>(LogLevel::NUM_OF_LEVELS),
+              "Names of all log levels should be defined");
+
+constexpr LogLevel default_level{LogLevel::INFO};
+}  // namespace
+
+LogFilter&
+LogFilter::instance()
+{
+    static LogFilter log_filter;
+    return log_filter;
+}
+
+LogFilter::LogFilter()
+{
+    levels_.fill(default_level);
+}
+
+void
+LogFilter::set_level(LogModule module, LogLevel level)
+{
+    levels_[static_cast<size_t>(module)] = level;
+}
+
+LogLevel
+LogFilter::level(LogModule module) const
+{
+    return levels_[static_cast<size_t>(module)];
+}
+
+bool
+LogFilter::configure(String const& settings)
+{
+    auto new_levels = levels_;
+    int  start{0};
+    while (start < static_cast<int>(settings.length())) {
+        auto end = settings.indexOf(' ', start);
+        if (end == -1) {
+            end = settings.length();
+        }
+        auto pair = settings.substring(start, end);
+        start     = end + 1;
+        if (pair.length() == 0) {
+            continue;  // Several spaces in a row
+        }
+
+        auto separator_position = pair.indexOf('=');
+        if (separator_position == -1) {
+            return false;
+        }
+        auto     module_str = pair.substring(0, separator_position);
+        LogLevel level;
+        if (!parse_level(pair.substring(separator_position + 1), level)) {
+            return false;
+        }
+        if (module_str == "*") {
+            new_levels.fill(level);
+            continue;
+        }
+        LogModule module;
+        if (!parse_module(module_str, module)) {
+            return false;
+        }
+        new_levels[static_cast<size_t>(module)] = level;
+    }
+
+    levels_ = new_levels;
+    return true;
+}
+
+String
+LogFilter::to_string() const
+{
+    String result;
+    for (size_t i = 0; i < levels_.size(); ++i) {
+        if (i != 0) {
+            result += ' ';
+        }
+        result += FPSTR(module_name(static_cast<LogModule>(i)));
+        result += '=';
+        result += FPSTR(level_name(levels_[i]));
+    }
+    return result;
+}
+
+PGM_P
+LogFilter::module_name(LogModule module)
+{
+    return reinterpret_cast<PGM_P>(pgm_read_ptr(&module_names[static_cast<size_t>(module)]));
+}
+
+PGM_P
+LogFilter::level_name(LogLevel level)
+{
+    return reinterpret_cast<PGM_P>(pgm_read_ptr(&level_names[static_cast<size_t>(level)]));
+}
+
+bool
+LogFilter::parse_module(String const& name, LogModule& module)
+{
+    for (uint8_t i = 0; i < static_cast<uint8_t>(LogModule::NUM_OF_MODULES); ++i) {
+        if (name.equalsIgnoreCase(FPSTR(module_name(static_cast<LogModule>(i))))) {
+            module = static_cast<LogModule>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+LogFilter::parse_level(String const& name, LogLevel& level)
+{
+    for (uint8_t i = 0; i < static_cast<uint8_t>(LogLevel::NUM_OF_LEVELS); ++i) {
+        if (name.equalsIgnoreCase(FPSTR(level_name(static_cast<LogLevel>(i))))) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,69 @@
+#ifndef LOGFILTER_H_
+#define LOGFILTER_H_
+
+#include <array>
+
+#include <Arduino.h>
+#include <WString.h>
+
+enum class LogLevel : uint8_t
+{
+    ERROR = 0,
+    WARNING,
+    INFO,
+    DEBUG,
+    TRACE,
+
+    NUM_OF_LEVELS
+};
+
+enum class LogModule : uint8_t
+{
+    SYSTEM = 0,  // Logs, which do not belong to any other module. Also plain text, printed into logger
+    WEB,
+    WS,
+    ARDUINO,
+    STK500,
+    FS,
+
+    NUM_OF_MODULES
+};
+
+// Runtime filter of logs. Every module has its own level: logs of this level and more important ones are recorded.
+// Levels can be changed with settings string of "module=level" pairs, separated by spaces,
+// ex. "web=debug stk500=trace". Module "*" means all modules.
+class LogFilter
+{
+public:
+    // Singleton
+    static LogFilter& instance();
+    LogFilter(LogFilter&)  = delete;
+    LogFilter(LogFilter&&) = delete;
+    LogFilter& operator=(LogFilter&) = delete;
+    LogFilter& operator=(LogFilter&&) = delete;
+
+    bool
+    is_enabled(LogModule module, LogLevel level) const
+    {
+        return level <= levels_[static_cast<size_t>(module)];
+    }
+    void     set_level(LogModule module, LogLevel level);
+    LogLevel level(LogModule module) const;
+
+    // Returns false if settings contain unknown module or level. In that case no levels are changed
+    bool   configure(String const& settings);
+    String to_string() const;
+
+    static PGM_P module_name(LogModule module);
+    static PGM_P level_name(LogLevel level);
+    // Return false if name is unknown
+    static bool parse_module(String const& name, LogModule& module);
+    static bool parse_level(String const& name, LogLevel& level);
+
+private:
+    LogFilter();
+
+    std::array<LogLevel, static_cast<size_t>(LogModule::NUM_OF_MODULES)> levels_;
+};
+
+#endif  // LOGFILTER_H_
@@ -0,0 +1,86 @@
+#include "LogQuery.h"
+
+namespace
+{
+constexpr char level_parameter[] PROGMEM   = "level=";
+constexpr char modules_parameter[] PROGMEM = "modules=";
+constexpr char text_parameter[] PROGMEM    = "text=";
+}  // namespace
+
+constexpr uint8_t LogQuery::all_modules_mask;
+
+bool
+LogQuery::parse(String const& parameters)
+{
+    LogLevel level{LogLevel::TRACE};
+    uint8_t  modules_mask{all_modules_mask};
+    String   text;
+
+    int start{0};
+    while (start < static_cast<int>(parameters.length())) {
+        if (parameters[start] == ' ') {
+            ++start;
+            continue;
+        }
+        // Substring is the rest of parameters
+        if (parameters.startsWith(FPSTR(text_parameter), start)) {
+            text = parameters.substring(start + strlen_P(text_parameter));
+            break;
+        }
+
+        auto end = parameters.indexOf(' ', start);
+        if (end == -1) {
+            end = parameters.length();
+        }
+        auto parameter = parameters.substring(start, end);
+        start          = end + 1;
+        if (parameter.startsWith(FPSTR(level_parameter))) {
+            if (!LogFilter::parse_level(parameter.substring(strlen_P(level_parameter)), level)) {
+                return false;
+            }
+        }
+        else if (parameter.startsWith(FPSTR(modules_parameter))) {
+            auto modules = parameter.substring(strlen_P(modules_parameter));
+            modules_mask = 0;
+            int module_start{0};
+            while (module_start < static_cast<int>(modules.length())) {
+                auto module_end = modules.indexOf(',', module_start);
+                if (module_end == -1) {
+                    module_end = modules.length();
+                }
+                LogModule module;
+                if (!LogFilter::parse_module(modules.substring(module_start, module_end), module)) {
+                    return false;
+                }
+                modules_mask |= 1 << static_cast<uint8_t>(module);
+                module_start = module_end + 1;
+            }
+        }
+        else {
+            return false;
+        }
+    }
+
+    level_        = level;
+    modules_mask_ = modules_mask;
+    text_         = text;
+    return true;
+}
+
+bool
+LogQuery::matches(LogLevel level, LogModule module) const
+{
+    return (level <= level_) && ((modules_mask_ & (1 << static_cast<uint8_t>(module))) != 0);
+}
+
+bool
+LogQuery::matches(String const& text) const
+{
+    return text_.isEmpty() || (text.indexOf(text_) != -1);
+}
+
+bool
+LogQuery::has_text() const
+{
+    return !text_.isEmpty();
+}
@@ -0,0 +1,31 @@
+#ifndef LOGQUERY_H_
+#define LOGQUERY_H_
+
+#include <WString.h>
+
+#include "LogFilter.h"
+
+// Filter of log records, requested by log viewer. Parameters are separated by spaces, all of them are optional:
+//   level=<level>                - records of this level and more important ones
+//   modules=<module>,<module>... - records of these modules only
+//   text=<substring>             - records, which contain substring (case-sensitive). It should be the last parameter,
+//                                  so substring can contain spaces
+class LogQuery
+{
+public:
+    // Returns false if parameters are malformed. In that case query is not changed
+    bool parse(String const& parameters);
+
+    bool matches(LogLevel level, LogModule module) const;
+    bool matches(String const& text) const;
+    bool has_text() const;
+
+private:
+    static constexpr uint8_t all_modules_mask{(1 << static_cast<uint8_t>(LogModule::NUM_OF_MODULES)) - 1};
+
+    LogLevel level_{LogLevel::TRACE};
+    uint8_t  modules_mask_{all_modules_mask};
+    String   text_;
+};
+
+#endif  // LOGQUERY_H_
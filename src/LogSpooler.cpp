@@ -0,0 +1,264 @@
+#include "LogSpooler.h"
+
+#include <FS.h>
+
+#include "FsIndex.h"
+#include "logger.h"
+
+namespace
+{
+constexpr char    log_file_prefix[] PROGMEM = "/logs/log";
+constexpr char    log_file_suffix[] PROGMEM = ".txt";
+constexpr char    log_index_path[] PROGMEM  = "/logs/index";
+constexpr uint8_t num_of_log_files{4};
+constexpr size_t  max_log_file_size{16 * 1024};
+
+constexpr size_t pages_per_block{4};
+// Flash writes: burst and average rate (one write per minute, i.e. about 60 KB per hour)
+constexpr uint8_t       write_burst{8};
+constexpr unsigned long write_refill_period{60 * 1000};
+
+constexpr uint32_t rtc_log_magic{0x4C4F4731};  // "LOG1"
+constexpr uint32_t rtc_log_offset{128 / 4};    // In 4-byte blocks. First 128 bytes of RTC user memory are used by OTA
+constexpr size_t   rtc_user_memory_size{512};
+
+uint32_t
+fnv1a(String const& text)
+{
+    uint32_t hash{2166136261u};
+    for (size_t i = 0; i < text.length(); ++i) {
+        hash = (hash ^ static_cast<uint8_t>(text[i])) * 16777619u;
+    }
+    return hash;
+}
+
+String
+log_file_path(uint8_t index)
+{
+    String path{FPSTR(log_file_prefix)};
+    path += index;
+    path += FPSTR(log_file_suffix);
+    return path;
+}
+}  // namespace
+
+constexpr size_t LogSpooler::rtc_log_capacity;
+
+LogSpooler::LogSpooler(bool should_spool_to_flash)
+  : should_spool_to_flash_{should_spool_to_flash}
+  , write_limiter_{write_burst, write_refill_period}
+{
+    static_assert(rtc_log_offset * 4 + sizeof(RtcLog) <= rtc_user_memory_size, "RTC log doesn't fit in RTC memory");
+}
+
+void
+LogSpooler::init()
+{
+    auto& logger = BufferedLogger::instance();
+    // Logs, which were recorded since boot, are saved as any others. Logs, replayed from RTC memory, are only shown:
+    // they are already in flash, if they were spooled before reset
+    cursor_            = logger.begin_offset();
+    auto boot_logs_end = logger.end_offset();
+    replay_rtc_log();
+    auto replayed_logs_end = logger.end_offset();
+
+    if (should_spool_to_flash_) {
+        FSInfo fs_info;
+        if (SPIFFS.info(fs_info)) {
+            block_size_ = fs_info.pageSize * pages_per_block;
+        }
+        File index_file = SPIFFS.open(FPSTR(log_index_path), "r");
+        if (index_file) {
+            current_file_ = index_file.parseInt() % num_of_log_files;
+            index_file.close();
+        }
+        write_limiter_.reset(millis());
+        block_.reserve(block_size_);
+    }
+
+    read_logs(boot_logs_end);
+    cursor_ = replayed_logs_end;
+    LOG_INFO(SYSTEM, PSTR("Reset reason: %s\n"), ESP.getResetReason().c_str());
+    if (should_spool_to_flash_) {
+        LOG_INFO(SYSTEM,
+                 PSTR("Log spooler initialized. Logs are written to %s\n"),
+                 log_file_path(current_file_).c_str());
+    }
+    read_logs(logger.end_offset());
+    save_rtc_log();
+}
+
+void
+LogSpooler::loop()
+{
+    if (cursor_ == BufferedLogger::instance().end_offset()) {
+        return;
+    }
+
+    read_logs(BufferedLogger::instance().end_offset());
+    save_rtc_log();
+    if (should_spool_to_flash_) {
+        write_blocks(false);
+    }
+}
+
+void
+LogSpooler::flush()
+{
+    if (!should_spool_to_flash_) {
+        return;
+    }
+
+    BufferedLogger::instance().flush_repeats();
+    read_logs(BufferedLogger::instance().end_offset());
+    save_rtc_log();
+    write_blocks(true);
+}
+
+void
+LogSpooler::read_logs(uint32_t end_offset)
+{
+    auto& logger       = BufferedLogger::instance();
+    auto  begin_offset = logger.begin_offset();
+    auto  log_end      = logger.end_offset();
+    // Offsets wrap around, so compare them by distance from the end of log
+    if (log_end - cursor_ > log_end - begin_offset) {
+        // Records were overwritten before they were read. Even "end_offset" could be overwritten
+        auto lost_end = (log_end - end_offset > log_end - begin_offset) ? end_offset : begin_offset;
+        if (should_spool_to_flash_) {
+            block_ += F("\n[");
+            block_ += lost_end - cursor_;
+            block_ += F(" bytes lost]\n");
+        }
+        cursor_ = lost_end;
+    }
+
+    // Records are only copied here. They are rendered into text only if they go to flash
+    uint8_t record[BufferedLogger::max_record_size];
+    size_t  size;
+    while (cursor_ != end_offset) {
+        auto next_offset = logger.copy_record(cursor_, record, size);
+        append_to_rtc_log(record, size);
+        if (should_spool_to_flash_) {
+            logger.render_record(record, size, block_);
+        }
+        cursor_ = next_offset;
+    }
+}
+
+void
+LogSpooler::replay_rtc_log()
+{
+    rtc_log_.magic       = rtc_log_magic;
+    rtc_log_.firmware_id = fnv1a(ESP.getSketchMD5());
+    RtcLog saved_log;
+    if (!ESP.rtcUserMemoryRead(rtc_log_offset, reinterpret_cast<uint32_t*>(&saved_log), sizeof(saved_log)) ||
+        (saved_log.magic != rtc_log_magic) || (saved_log.size > rtc_log_capacity) || (saved_log.size == 0)) {
+        LOG_INFO(SYSTEM, PSTR("There are no logs before reset\n"));
+        return;
+    }
+    if (saved_log.firmware_id != rtc_log_.firmware_id) {
+        LOG_INFO(SYSTEM, PSTR("Logs before reset are not shown: they were recorded by another firmware\n"));
+        return;
+    }
+
+    LOG_INFO(SYSTEM, PSTR("The last %u bytes of log records before reset:\n"), saved_log.size);
+    String text;
+    for (size_t position = 0; position < saved_log.size;) {
+        auto size =
+            BufferedLogger::instance().render_record(saved_log.data + position, saved_log.size - position, text);
+        if (size == 0) {
+            break;
+        }
+        position += size;
+    }
+    BufferedLogger::instance().write(reinterpret_cast<uint8_t const*>(text.c_str()), text.length());
+    LOG_INFO(SYSTEM, PSTR("End of logs before reset\n"));
+}
+
+void
+LogSpooler::append_to_rtc_log(uint8_t const* record, size_t size)
+{
+    if (size > rtc_log_capacity) {
+        return;
+    }
+
+    // Keep only the latest records. The oldest ones are dropped as a whole
+    size_t dropped_size{0};
+    while (rtc_log_.size - dropped_size + size > rtc_log_capacity) {
+        uint16_t record_size;
+        memcpy(&record_size, rtc_log_.data + dropped_size, sizeof(record_size));
+        dropped_size += record_size;
+    }
+    rtc_log_.size -= dropped_size;
+    memmove(rtc_log_.data, rtc_log_.data + dropped_size, rtc_log_.size);
+    memcpy(rtc_log_.data + rtc_log_.size, record, size);
+    rtc_log_.size += size;
+}
+
+void
+LogSpooler::save_rtc_log()
+{
+    ESP.rtcUserMemoryWrite(rtc_log_offset, reinterpret_cast<uint32_t*>(&rtc_log_), sizeof(rtc_log_));
+}
+
+void
+LogSpooler::write_blocks(bool should_write_all)
+{
+    while ((block_.length() >= block_size_) || (should_write_all && (block_.length() > 0))) {
+        if (!should_write_all && !write_limiter_.try_consume(millis())) {
+            // Do not let logs occupy too much RAM, while write limit is exceeded
+            if (block_.length() >= 2 * block_size_) {
+                dropped_bytes_ += block_.length();
+                block_.clear();
+            }
+            return;
+        }
+
+        if (dropped_bytes_ != 0) {
+            String marker{F("\n[")};
+            marker += dropped_bytes_;
+            marker += F(" bytes of logs are not saved: limit of flash writes is exceeded]\n");
+            write(marker);
+            dropped_bytes_ = 0;
+        }
+
+        auto size = std::min(static_cast<size_t>(block_.length()), block_size_);
+        write(block_.substring(0, size));
+        block_.remove(0, size);
+    }
+}
+
+void
+LogSpooler::write(String const& text)
+{
+    auto           path = log_file_path(current_file_);
+    FsIndex::Entry entry;
+    if (FsIndex::instance().find(path, entry) && (entry.size + text.length() > max_log_file_size)) {
+        rotate();
+        path = log_file_path(current_file_);
+    }
+
+    File file = SPIFFS.open(path, "a");
+    if (!file) {
+        return;
+    }
+    file.write(reinterpret_cast<uint8_t const*>(text.c_str()), text.length());
+    file.close();
+    FsIndex::instance().update(path);
+}
+
+void
+LogSpooler::rotate()
+{
+    current_file_ = (current_file_ + 1) % num_of_log_files;
+    // Oldest file is overwritten
+    SPIFFS.remove(log_file_path(current_file_));
+    FsIndex::instance().remove(log_file_path(current_file_));
+    File index_file = SPIFFS.open(FPSTR(log_index_path), "w");
+    if (index_file) {
+        index_file.print(current_file_);
+        index_file.close();
+        FsIndex::instance().update(FPSTR(log_index_path));
+    }
+}
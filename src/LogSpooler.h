@@ -0,0 +1,55 @@
+#ifndef LOGSPOOLER_H_
+#define LOGSPOOLER_H_
+
+#include <Arduino.h>
+#include <WString.h>
+
+#include "TokenBucket.h"
+
+// Saves logs of BufferedLogger, so they survive reboot of ESP.
+// Logs are rendered into text and appended to rotating set of files in SPIFFS (/logs/log<N>.txt), which can be
+// downloaded as any other file. To reduce wear of flash, logs are written in blocks of several flash pages, and amount
+// of writes per hour is limited. Logs, which exceed the limit, are dropped and replaced with marker.
+// The latest log records are also mirrored into RTC user memory as raw bytes. It survives crash and WDT reset, so these
+// logs are rendered and replayed into log on the next boot, if firmware was not changed.
+class LogSpooler
+{
+public:
+    explicit LogSpooler(bool should_spool_to_flash = true);
+    // Should be called after SPIFFS is mounted
+    void init();
+    void loop();
+    // Write all pending logs to flash. Call it before deliberate reboot
+    void flush();
+
+private:
+    static constexpr size_t rtc_log_capacity{372};
+    // Layout of RTC user memory. First 128 bytes of it are used by OTA, so logs are stored after them
+    struct alignas(4) RtcLog
+    {
+        uint32_t magic;
+        uint32_t firmware_id;  // Records refer to PROGMEM format strings, which are valid only for the same firmware
+        uint32_t size;
+        uint8_t  data[rtc_log_capacity];  // Whole log records
+    };
+
+    // Render new records into block_ if logs are spooled to flash, and mirror them into rtc_log_
+    void read_logs(uint32_t end_offset);
+    void replay_rtc_log();
+    void append_to_rtc_log(uint8_t const* record, size_t size);
+    void save_rtc_log();
+    void write_blocks(bool should_write_all);
+    void write(String const& text);
+    void rotate();
+
+    bool        should_spool_to_flash_;
+    uint32_t    cursor_{0};  // Offset of the next log record in BufferedLogger
+    String      block_;
+    size_t      block_size_{1024};
+    size_t      dropped_bytes_{0};
+    TokenBucket write_limiter_;
+    uint8_t     current_file_{0};
+    RtcLog      rtc_log_{};
+};
+
+#endif  // LOGSPOOLER_H_
@@ -0,0 +1,195 @@
+#include "OtaSession.h"
+
+#include <algorithm>
+
+#include <Updater.h>
+
+#include "logger.h"
+
+namespace
+{
+String
+to_hex(uint8_t const* data, size_t size)
+{
+    String result;
+    result.reserve(size * 2);
+    for (size_t i = 0; i < size; ++i) {
+        char hex[3];
+        snprintf_P(hex, sizeof(hex), PSTR("%02x"), data[i]);
+        result += hex;
+    }
+    return result;
+}
+
+}  // namespace
+
+bool
+OtaSession::begin(size_t size, size_t image_size, String const& md5, String const& sha256)
+{
+    String md5_lower{md5};
+    String sha256_lower{sha256};
+    md5_lower.toLowerCase();
+    sha256_lower.toLowerCase();
+    // Only hash identifies image. Without it, upload of another image of the same size would continue old one
+    auto has_hash = (md5_lower.length() != 0) || (sha256_lower.length() != 0);
+    if ((state_ == State::RUNNING) && Update.isRunning() && has_hash && (size == size_) && (md5_lower == md5_) &&
+        (sha256_lower == sha256_)) {
+        LOG_INFO(WEB, PSTR("OTA: resuming at %u of %u bytes\n"), offset(), size_);
+        return true;
+    }
+
+    abort();
+    error_ = nullptr;
+    if ((md5_lower.length() != 0) && (md5_lower.length() != 32)) {
+        fail(PSTR("ERROR: invalid MD5"));
+        return false;
+    }
+    if ((sha256_lower.length() != 0) && (sha256_lower.length() != br_sha256_SIZE * 2)) {
+        fail(PSTR("ERROR: invalid SHA-256"));
+        return false;
+    }
+    // Updater checks only size of compressed image. Inflated image should fit too
+    if (std::max(size, image_size) > max_image_size()) {
+        fail(PSTR("ERROR: image is too big"));
+        return false;
+    }
+
+    // Updater should not yield, when it is called from web server callbacks
+    Update.runAsync(true);
+    if (!Update.begin(size)) {
+        Update.printError(DGB_STREAM);
+        Update.end();
+        fail(PSTR("ERROR: not enough space"));
+        return false;
+    }
+    if (md5_lower.length() != 0) {
+        // Updater checks MD5 by itself on end()
+        Update.setMD5(md5_lower.c_str());
+    }
+    br_sha256_init(&sha256_context_);
+
+    state_  = State::RUNNING;
+    size_   = size;
+    md5_    = md5_lower;
+    sha256_ = sha256_lower;
+    if (image_size != 0) {
+        LOG_INFO(WEB, PSTR("OTA: started, %u bytes, %u bytes after inflating\n"), size_, image_size);
+    }
+    else {
+        LOG_INFO(WEB, PSTR("OTA: started, %u bytes\n"), size_);
+    }
+    return true;
+}
+
+bool
+OtaSession::write(size_t offset, uint8_t const* data, size_t size)
+{
+    if ((state_ != State::RUNNING) || !Update.isRunning()) {
+        fail(PSTR("ERROR: update is not started"));
+        return false;
+    }
+
+    auto committed_size = this->offset();
+    if (offset > committed_size) {
+        // Not an error of session, client should resend data from offset()
+        error_ = PSTR("ERROR: wrong offset");
+        return false;
+    }
+    auto skipped_size = std::min(committed_size - offset, size);
+    data += skipped_size;
+    size -= skipped_size;
+    if (size > size_ - committed_size) {
+        fail(PSTR("ERROR: image is too big"));
+        return false;
+    }
+    if (size == 0) {
+        return true;
+    }
+
+    // SHA-256 is checked before the last byte is given to Updater, because Updater activates complete image on end()
+    br_sha256_update(&sha256_context_, data, size);
+    auto is_last = (committed_size + size == size_);
+    if (is_last && (sha256_.length() != 0)) {
+        uint8_t digest[br_sha256_SIZE];
+        br_sha256_out(&sha256_context_, digest);
+        if (to_hex(digest, sizeof(digest)) != sha256_) {
+            fail(PSTR("ERROR: SHA-256 mismatch"));
+            return false;
+        }
+    }
+
+    if (Update.write(const_cast<uint8_t*>(data), size) != size) {
+        Update.printError(DGB_STREAM);
+        fail(PSTR("ERROR: can not write image"));
+        return false;
+    }
+    return is_last ? finalize() : true;
+}
+
+void
+OtaSession::abort()
+{
+    if (Update.isRunning()) {
+        // Image is not complete, so Updater drops it
+        Update.end();
+    }
+    state_ = State::IDLE;
+}
+
+OtaSession::State
+OtaSession::state() const
+{
+    return state_;
+}
+
+size_t
+OtaSession::size() const
+{
+    return size_;
+}
+
+size_t
+OtaSession::offset() const
+{
+    return (state_ == State::COMPLETED) ? size_ : ((state_ == State::RUNNING) ? Update.progress() : 0);
+}
+
+PGM_P
+OtaSession::error() const
+{
+    return error_;
+}
+
+size_t
+OtaSession::max_image_size()
+{
+    // Running firmware is replaced by new one, so both of them are limited by the same region of flash
+    return ESP.getSketchSize() + ESP.getFreeSketchSpace();
+}
+
+bool
+OtaSession::finalize()
+{
+    // Updater checks MD5 and header of image here. If it fails, image is not activated
+    if (!Update.end()) {
+        Update.printError(DGB_STREAM);
+        if (Update.getError() == UPDATE_ERROR_MD5) {
+            fail(PSTR("ERROR: MD5 mismatch"));
+        }
+        else {
+            fail(PSTR("ERROR: can not finalize image"));
+        }
+        return false;
+    }
+    state_ = State::COMPLETED;
+    LOG_INFO(WEB, PSTR("OTA: completed, %u bytes\n"), size_);
+    return true;
+}
+
+void
+OtaSession::fail(PGM_P error)
+{
+    LOG_ERROR(WEB, PSTR("OTA: %s\n"), String{FPSTR(error)}.c_str());
+    error_ = error;
+    abort();
+}
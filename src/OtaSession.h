@@ -0,0 +1,57 @@
+#ifndef OTASESSION_H_
+#define OTASESSION_H_
+
+#include <bearssl/bearssl_hash.h>
+
+#include <Arduino.h>
+#include <WString.h>
+
+// Update of ESP firmware, which is uploaded in chunks. Every chunk carries its offset in image. Data is committed to
+// update partition by Updater as soon as it is received, so if connection is dropped, client asks for offset() and
+// continues from there. Session survives dropped connections, but not reboot of ESP.
+// Image can be checked against MD5 and/or SHA-256, given on begin(). Hashes are calculated while image is streamed, so
+// bad image is rejected before it is activated and ESP is rebooted.
+// Image can be compressed with gzip. Updater stores it as is and bootloader inflates it on reboot, so no RAM is spent
+// for decompression window. Hashes are checked against compressed image.
+class OtaSession
+{
+public:
+    enum class State : uint8_t
+    {
+        IDLE = 0,
+        RUNNING,
+        COMPLETED
+    };
+
+    // Start new session. If session with the same image size and hashes is already running, it is kept, so client
+    // continues from offset(). Session, started without hashes, is never continued. "image_size" is size of
+    // compressed image after inflating (0 if image is not compressed). Hashes are given as hex strings and can be empty
+    bool begin(size_t size, size_t image_size, String const& md5, String const& sha256);
+    // Write data, starting at "offset" of image. Part of data, which is already committed, is skipped. Data after gap
+    // is rejected. When the last byte of image is written, image is checked and activated
+    bool write(size_t offset, uint8_t const* data, size_t size);
+    void abort();
+
+    State  state() const;
+    size_t size() const;
+    // Size of committed part of image. Upload continues from here
+    size_t offset() const;
+    // Description of the last error, PROGMEM string
+    PGM_P  error() const;
+
+    // Maximal size of image, which fits into flash, occupied by firmware
+    static size_t max_image_size();
+
+private:
+    bool finalize();
+    void fail(PGM_P error);
+
+    State             state_{State::IDLE};
+    size_t            size_{0};
+    String            md5_;
+    String            sha256_;
+    br_sha256_context sha256_context_;
+    PGM_P             error_{nullptr};
+};
+
+#endif  // OTASESSION_H_
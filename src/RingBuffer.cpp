@@ -0,0 +1,134 @@
+#include "RingBuffer.h"
+
+RingBuffer::RingBuffer(size_t capacity)
+  : buffer_{new uint8_t[capacity]}
+  , capacity_{capacity}
+{
+}
+
+size_t
+RingBuffer::write(uint8_t const* data, size_t size)
+{
+    end_offset_ += size;
+
+    size_t overwritten{0};
+    if (size > capacity_) {
+        // Only the last "capacity_" bytes will stay in buffer
+        overwritten = size_ + (size - capacity_);
+        data += size - capacity_;
+        size  = capacity_;
+        head_ = 0;
+        size_ = 0;
+    }
+    else if (size_ + size > capacity_) {
+        overwritten = size_ + size - capacity_;
+        head_       = (head_ + overwritten) % capacity_;
+        size_ -= overwritten;
+    }
+
+    // Copy with at most 2 memcpy: till the end of buffer and from its beginning
+    size_t tail       = (head_ + size_) % capacity_;
+    size_t first_part = std::min(size, capacity_ - tail);
+    memcpy(buffer_.get() + tail, data, first_part);
+    memcpy(buffer_.get(), data + first_part, size - first_part);
+    size_ += size;
+    return overwritten;
+}
+
+void
+RingBuffer::clear()
+{
+    head_ = (head_ + size_) % capacity_;
+    size_ = 0;
+}
+
+void
+RingBuffer::discard(size_t size)
+{
+    size  = std::min(size, size_);
+    head_ = (head_ + size) % capacity_;
+    size_ -= size;
+}
+
+void
+RingBuffer::truncate(size_t size)
+{
+    size = std::min(size, size_);
+    size_ -= size;
+    end_offset_ -= size;
+}
+
+void
+RingBuffer::read(uint32_t offset, uint8_t* data, size_t size) const
+{
+    size_t start      = position(offset);
+    size_t first_part = std::min(size, capacity_ - start);
+    memcpy(data, buffer_.get() + start, first_part);
+    memcpy(data + first_part, buffer_.get(), size - first_part);
+}
+
+void
+RingBuffer::overwrite(uint32_t offset, uint8_t const* data, size_t size)
+{
+    size_t start      = position(offset);
+    size_t first_part = std::min(size, capacity_ - start);
+    memcpy(buffer_.get() + start, data, first_part);
+    memcpy(buffer_.get(), data + first_part, size - first_part);
+}
+
+RingBuffer::Segments
+RingBuffer::segments() const
+{
+    return segments(begin_offset());
+}
+
+RingBuffer::Segments
+RingBuffer::segments(uint32_t from_offset) const
+{
+    // Offsets wrap around, so compare them by distance from the end
+    size_t skip{0};
+    if (end_offset_ - from_offset < size_) {
+        skip = size_ - (end_offset_ - from_offset);
+    }
+
+    size_t start      = (head_ + skip) % capacity_;
+    size_t size       = size_ - skip;
+    size_t first_part = std::min(size, capacity_ - start);
+    return {{{buffer_.get() + start, first_part}, {buffer_.get(), size - first_part}}};
+}
+
+size_t
+RingBuffer::size() const
+{
+    return size_;
+}
+
+size_t
+RingBuffer::capacity() const
+{
+    return capacity_;
+}
+
+size_t
+RingBuffer::free_space() const
+{
+    return capacity_ - size_;
+}
+
+uint32_t
+RingBuffer::begin_offset() const
+{
+    return end_offset_ - size_;
+}
+
+uint32_t
+RingBuffer::end_offset() const
+{
+    return end_offset_;
+}
+
+size_t
+RingBuffer::position(uint32_t offset) const
+{
+    return (head_ + (offset - begin_offset())) % capacity_;
+}
@@ -0,0 +1,63 @@
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+#include <array>
+#include <memory>
+
+#include <Arduino.h>
+
+// Preallocated circular byte buffer. When buffer is full, new data overwrites the oldest one.
+// Every written byte gets monotonically increasing offset (wraps around after 4 GB), so several readers can keep their
+// own read cursors and detect, how many bytes were overwritten before they read them.
+class RingBuffer
+{
+public:
+    // Contiguous part of stored data
+    struct Segment
+    {
+        uint8_t const* data;
+        size_t         size;
+    };
+    // Stored data from the oldest to the newest byte. Second segment is empty, unless data wraps around end of buffer
+    using Segments = std::array<Segment, 2>;
+
+    explicit RingBuffer(size_t capacity);
+
+    // Returns amount of the oldest bytes, which were overwritten
+    size_t write(uint8_t const* data, size_t size);
+    // Drop stored data. Offsets of next bytes continue from end_offset()
+    void clear();
+    // Drop "size" oldest bytes
+    void discard(size_t size);
+    // Drop "size" newest bytes. Offsets of next bytes continue from new end_offset()
+    void truncate(size_t size);
+
+    // Copy "size" bytes, starting from "offset". These bytes must be stored in buffer
+    void read(uint32_t offset, uint8_t* data, size_t size) const;
+    // Replace already written bytes, starting from "offset"
+    void overwrite(uint32_t offset, uint8_t const* data, size_t size);
+
+    Segments segments() const;
+    // Stored data starting from "from_offset". If it was already overwritten, data starts from begin_offset()
+    Segments segments(uint32_t from_offset) const;
+    size_t   size() const;
+    size_t   capacity() const;
+    size_t   free_space() const;
+
+    // Offset of the oldest stored byte
+    uint32_t begin_offset() const;
+    // Offset of the next byte to be written
+    uint32_t end_offset() const;
+
+private:
+    // Position of byte with given offset in buffer_
+    size_t position(uint32_t offset) const;
+
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t                     capacity_;
+    size_t                     head_{0};  // Position of the oldest byte
+    size_t                     size_{0};
+    uint32_t                   end_offset_{0};
+};
+
+#endif  // RINGBUFFER_H_
@@ -0,0 +1,159 @@
+#include "SettingsCodec.h"
+
+#include <Arduino.h>
+
+namespace
+{
+constexpr size_t header_size{5};  // Frame type + request ID
+
+void
+put_uint16(SettingsCodec::Frame& frame, uint16_t value)
+{
+    frame.push_back(static_cast<uint8_t>(value & 0xFF));
+    frame.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+uint16_t
+get_uint16(uint8_t const* data)
+{
+    return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+void
+put_header(SettingsCodec::Frame& frame, SettingsCodec::FrameType type, uint32_t request_id)
+{
+    frame.push_back(static_cast<uint8_t>(type));
+    for (uint8_t i = 0; i < 4; ++i) {
+        frame.push_back(static_cast<uint8_t>(request_id >> (8 * i)));
+    }
+}
+
+size_t
+payload_size(SettingsCodec::FrameType type)
+{
+    switch (type) {
+    case SettingsCodec::FrameType::GET_SETTINGS:
+        return 0;
+    case SettingsCodec::FrameType::SET_DATETIME:
+        return 7;
+    case SettingsCodec::FrameType::ENABLE_ALARM:
+        return 1;
+    case SettingsCodec::FrameType::SET_ALARM_TIME:
+        return 3;
+    case SettingsCodec::FrameType::SET_SUNRISE_DURATION:
+    case SettingsCodec::FrameType::SET_BRIGHTNESS:
+        return 2;
+    default:
+        return SIZE_MAX;
+    }
+}
+}  // namespace
+
+namespace SettingsCodec
+{
+Frame
+encode_settings(ArduinoSettings const& settings, uint8_t fields_mask, bool is_snapshot, uint32_t request_id)
+{
+    using Field = ArduinoSettings::Field;
+
+    Frame frame;
+    frame.reserve(header_size + 2 + 7 + 4 + 2 + 3);
+    put_header(frame, is_snapshot ? FrameType::SETTINGS_SNAPSHOT : FrameType::SETTINGS_DELTA, request_id);
+
+    uint8_t present_mask = fields_mask & settings.valid_fields;
+    frame.push_back(present_mask);
+    frame.push_back(fields_mask & ~settings.valid_fields);  // Fields, which were requested but not received
+
+    if (present_mask & ArduinoSettings::field_mask(Field::TIME)) {
+        frame.push_back(settings.time.hour);
+        frame.push_back(settings.time.minute);
+        frame.push_back(settings.time.second);
+        frame.push_back(settings.time.day);
+        frame.push_back(settings.time.month);
+        put_uint16(frame, settings.time.year);
+    }
+    if (present_mask & ArduinoSettings::field_mask(Field::ALARM)) {
+        frame.push_back(settings.alarm.is_enabled ? 1 : 0);
+        frame.push_back(settings.alarm.hour);
+        frame.push_back(settings.alarm.minute);
+        frame.push_back(settings.alarm.dow);
+    }
+    if (present_mask & ArduinoSettings::field_mask(Field::SUNRISE_DURATION)) {
+        put_uint16(frame, settings.sunrise_duration);
+    }
+    if (present_mask & ArduinoSettings::field_mask(Field::BRIGHTNESS)) {
+        frame.push_back(settings.brightness.is_auto ? 1 : 0);
+        put_uint16(frame, settings.brightness.value);
+    }
+    return frame;
+}
+
+Frame
+encode_status(String const& message, uint32_t request_id)
+{
+    Frame frame;
+    frame.reserve(header_size + 1 + message.length());
+    put_header(frame, FrameType::STATUS, request_id);
+
+    Status status{Status::INFO};
+    if (message.startsWith(F("ERROR"))) {
+        status = Status::ERROR;
+    }
+    else if (message == F("DONE")) {
+        status = Status::DONE;
+    }
+    else if (message.startsWith(F("BUSY"))) {
+        status = Status::BUSY;
+    }
+    frame.push_back(static_cast<uint8_t>(status));
+    frame.insert(frame.end(), message.c_str(), message.c_str() + message.length());
+    return frame;
+}
+
+bool
+decode_command(uint8_t const* data, size_t length, FrameType& type, uint32_t& request_id, String& parameters)
+{
+    if (length < header_size) {
+        return false;
+    }
+    type = static_cast<FrameType>(data[0]);
+    if ((payload_size(type) == SIZE_MAX) || (length != header_size + payload_size(type))) {
+        return false;
+    }
+    request_id = data[1] | (data[2] << 8) | (data[3] << 16) | (static_cast<uint32_t>(data[4]) << 24);
+
+    // Convert parameters to the same form, as text-based commands have, so they can be passed to Arduino as is
+    uint8_t const* payload = data + header_size;
+    char           buffer[32];
+    switch (type) {
+    case FrameType::GET_SETTINGS:
+        parameters.clear();
+        return true;
+    case FrameType::SET_DATETIME:
+        snprintf_P(buffer,
+                   sizeof(buffer),
+                   PSTR("%02u:%02u:%02u %02u/%02u/%04u"),
+                   payload[0],
+                   payload[1],
+                   payload[2],
+                   payload[3],
+                   payload[4],
+                   get_uint16(payload + 5));
+        break;
+    case FrameType::ENABLE_ALARM:
+        snprintf_P(buffer, sizeof(buffer), PSTR("%c"), payload[0] ? 'E' : 'D');
+        break;
+    case FrameType::SET_ALARM_TIME:
+        snprintf_P(buffer, sizeof(buffer), PSTR("%02u:%02u %x"), payload[0], payload[1], payload[2]);
+        break;
+    case FrameType::SET_SUNRISE_DURATION:
+    case FrameType::SET_BRIGHTNESS:
+        snprintf_P(buffer, sizeof(buffer), PSTR("%04u"), get_uint16(payload));
+        break;
+    default:
+        return false;
+    }
+    parameters = buffer;
+    return true;
+}
+}  // namespace SettingsCodec
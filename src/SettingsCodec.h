@@ -0,0 +1,67 @@
+#ifndef SETTINGSCODEC_H_
+#define SETTINGSCODEC_H_
+
+#include <vector>
+
+#include <WString.h>
+
+#include "ArduinoSettings.h"
+
+// Compact binary encoding of settings channel. It is used by clients, which connected to WebSocket server with
+// "/binary" URL. Every frame starts with frame type and 32-bit request ID. All numbers are little-endian.
+//
+// ESP -> client:
+//   SETTINGS_SNAPSHOT, SETTINGS_DELTA: [type][request_id:4][present fields mask][error fields mask][fields...]
+//     Only fields, present in mask, are written, in order of ArduinoSettings::Field:
+//       TIME:             [hour][minute][second][day][month][year:2]
+//       ALARM:            [flags: bit 0 - enabled][hour][minute][days of week mask]
+//       SUNRISE_DURATION: [minutes:2]
+//       BRIGHTNESS:       [flags: bit 0 - automatic mode][value:2]
+//   STATUS:                 [type][request_id:4][status][UTF-8 message...]
+//
+// client -> ESP:
+//   GET_SETTINGS:         [type][request_id:4]
+//   SET_DATETIME:         [type][request_id:4][hour][minute][second][day][month][year:2]
+//   ENABLE_ALARM:         [type][request_id:4][0 - disable, 1 - enable]
+//   SET_ALARM_TIME:       [type][request_id:4][hour][minute][days of week mask]
+//   SET_SUNRISE_DURATION: [type][request_id:4][minutes:2]
+//   SET_BRIGHTNESS:       [type][request_id:4][value:2]
+namespace SettingsCodec
+{
+enum class FrameType : uint8_t
+{
+    SETTINGS_SNAPSHOT = 0x01,
+    SETTINGS_DELTA    = 0x02,
+    STATUS            = 0x03,
+
+    GET_SETTINGS         = 0x10,
+    SET_DATETIME         = 0x11,
+    ENABLE_ALARM         = 0x12,
+    SET_ALARM_TIME       = 0x13,
+    SET_SUNRISE_DURATION = 0x14,
+    SET_BRIGHTNESS       = 0x15,
+};
+
+enum class Status : uint8_t
+{
+    DONE = 0,
+    ERROR,
+    INFO,  // Intermediate message. More messages for this request will follow
+    BUSY,  // Command was rejected by rate limiter
+};
+
+using Frame = std::vector<uint8_t>;
+
+Frame encode_settings(ArduinoSettings const& settings, uint8_t fields_mask, bool is_snapshot, uint32_t request_id);
+Frame encode_status(String const& message, uint32_t request_id);
+
+// Decode command from client. "parameters" are converted to the same text form as parameters of text commands.
+// Returns false if frame is malformed
+bool decode_command(uint8_t const* data,
+                    size_t         length,
+                    FrameType&     type,
+                    uint32_t&      request_id,
+                    String&        parameters);
+}  // namespace SettingsCodec
+
+#endif  // SETTINGSCODEC_H_
@@ -16,22 +16,22 @@ Stk500Protocol::setup_device()
     reset_mcu();
 
     int s = get_sync();
-    DEBUG_PRINTF(PSTR("avrflash: sync=d%d/0x%x\n"), s, s);
+    LOG_DEBUG(STK500, PSTR("avrflash: sync=d%d/0x%x\n"), s, s);
     if (!s)
         return false;
 
     s = set_prog_params();
-    DEBUG_PRINTF(PSTR("avrflash: setparam=d%d/0x%x\n"), s, s);
+    LOG_DEBUG(STK500, PSTR("avrflash: setparam=d%d/0x%x\n"), s, s);
     if (!s)
         return false;
 
     s = set_ext_prog_params();
-    DEBUG_PRINTF(PSTR("avrflash: setext=d%d/0x%x\n"), s, s);
+    LOG_DEBUG(STK500, PSTR("avrflash: setext=d%d/0x%x\n"), s, s);
     if (!s)
         return false;
 
     s = enter_prog_mode();
-    DEBUG_PRINTF(PSTR("avrflash: progmode=d%d/0x%x\n"), s, s);
+    LOG_DEBUG(STK500, PSTR("avrflash: progmode=d%d/0x%x\n"), s, s);
     if (!s)
         return false;
 
@@ -43,7 +43,7 @@ Stk500Protocol::flash_page(uint8_t* load_addr, uint8_t* data)
 {
     uint8_t header[] = {0x64, 0x00, 0x80, 0x46};
     int     s        = load_address(load_addr[0], load_addr[1]);
-    DEBUG_PRINTF(PSTR("avrflash: loadAddr(%d,%d)=%d\n"), load_addr[1], load_addr[0], s);
+    LOG_TRACE(STK500, PSTR("avrflash: loadAddr(%d,%d)=%d\n"), load_addr[1], load_addr[0], s);
 
     serial_->write(header, 4);
     for (int i = 0; i < 128; i++)
@@ -52,12 +52,12 @@ Stk500Protocol::flash_page(uint8_t* load_addr, uint8_t* data)
 
     s = wait_for_serial_data(2, 1000);
     if (s == 0) {
-        DEBUG_PRINTF(PSTR("avrflash: flashpage: ack: error\n"));
+        LOG_ERROR(STK500, PSTR("avrflash: flashpage: ack: error\n"));
         return false;
     }
     s     = serial_->read();
     int t = serial_->read();
-    DEBUG_PRINTF(PSTR("avrflash: flashpage: ack: d%d/d%d - 0x%x/0x%x\n"), s, t, s, t);
+    LOG_TRACE(STK500, PSTR("avrflash: flashpage: ack: d%d/d%d - 0x%x/0x%x\n"), s, t, s, t);
 
     return true;
 }
@@ -0,0 +1,48 @@
+#include "TokenBucket.h"
+
+TokenBucket::TokenBucket(uint8_t capacity, unsigned long refill_period)
+  : capacity_{capacity}
+  , tokens_{capacity}
+  , refill_period_{refill_period}
+{
+}
+
+void
+TokenBucket::reset(unsigned long now)
+{
+    tokens_           = capacity_;
+    last_refill_time_ = now;
+}
+
+bool
+TokenBucket::try_consume(unsigned long now)
+{
+    refill(now);
+    if (tokens_ == 0) {
+        return false;
+    }
+    --tokens_;
+    return true;
+}
+
+void
+TokenBucket::refill(unsigned long now)
+{
+    if (refill_period_ == 0) {
+        tokens_ = capacity_;
+        return;
+    }
+
+    auto new_tokens = (now - last_refill_time_) / refill_period_;
+    if (new_tokens == 0) {
+        return;
+    }
+    if (tokens_ + new_tokens >= capacity_) {
+        tokens_           = capacity_;
+        last_refill_time_ = now;
+    }
+    else {
+        tokens_ += new_tokens;
+        last_refill_time_ += new_tokens * refill_period_;
+    }
+}
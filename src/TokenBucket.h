@@ -0,0 +1,28 @@
+#ifndef TOKENBUCKET_H_
+#define TOKENBUCKET_H_
+
+#include <Arduino.h>
+
+// Rate limiter. Bucket holds up to "capacity" tokens and gets one token every "refill_period" ms. Every admitted
+// operation consumes one token, so short bursts up to capacity are allowed, but average rate is limited.
+class TokenBucket
+{
+public:
+    explicit TokenBucket(uint8_t capacity = 1, unsigned long refill_period = 0);
+
+    // Refill bucket completely
+    void reset(unsigned long now);
+
+    // Returns false if there are no tokens left
+    bool try_consume(unsigned long now);
+
+private:
+    void refill(unsigned long now);
+
+    uint8_t       capacity_;
+    uint8_t       tokens_;
+    unsigned long refill_period_;  // ms
+    unsigned long last_refill_time_{0};
+};
+
+#endif  // TOKENBUCKET_H_
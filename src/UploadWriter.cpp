@@ -0,0 +1,100 @@
+#include "UploadWriter.h"
+
+#include "FsIndex.h"
+
+namespace
+{
+constexpr size_t pages_per_write{8};
+constexpr size_t default_page_size{256};
+// Every data page of SPIFFS starts with header (object ID, span index and flags, see spiffs_page_header in
+// spiffs_nucleus.h), so page holds less data, than its logical size
+constexpr size_t page_header_size{5};
+}  // namespace
+
+bool
+UploadWriter::open(String const& path)
+{
+    file_ = SPIFFS.open(path, "w");
+    if (!file_) {
+        return false;
+    }
+
+    FSInfo fs_info;
+    auto   page_size = SPIFFS.info(fs_info) ? fs_info.pageSize : default_page_size;
+    buffer_capacity_ = (page_size - page_header_size) * pages_per_write;
+    buffer_.reset(new (std::nothrow) uint8_t[buffer_capacity_]);
+    if (!buffer_) {
+        file_.close();
+        return false;
+    }
+
+    path_         = path;
+    buffer_size_  = 0;
+    size_         = 0;
+    content_hash_ = FsIndex::empty_content_hash;
+    open_time_    = millis();
+    return true;
+}
+
+bool
+UploadWriter::write(uint8_t const* data, size_t size)
+{
+    content_hash_ = FsIndex::hash_content(content_hash_, data, size);
+    while (size > 0) {
+        auto chunk_size = std::min(size, buffer_capacity_ - buffer_size_);
+        memcpy(buffer_.get() + buffer_size_, data, chunk_size);
+        buffer_size_ += chunk_size;
+        data += chunk_size;
+        size -= chunk_size;
+        if ((buffer_size_ == buffer_capacity_) && !flush()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+UploadWriter::close()
+{
+    auto is_flushed = flush();
+    file_.close();
+    buffer_.reset();
+    return is_flushed;
+}
+
+String const&
+UploadWriter::path() const
+{
+    return path_;
+}
+
+size_t
+UploadWriter::size() const
+{
+    return size_;
+}
+
+uint32_t
+UploadWriter::content_hash() const
+{
+    return content_hash_;
+}
+
+unsigned long
+UploadWriter::elapsed_time() const
+{
+    return millis() - open_time_;
+}
+
+bool
+UploadWriter::flush()
+{
+    if (buffer_size_ == 0) {
+        return true;
+    }
+    auto written_size = file_.write(buffer_.get(), buffer_size_);
+    size_ += written_size;
+    auto is_written = (written_size == buffer_size_);
+    buffer_size_    = 0;
+    return is_written;
+}
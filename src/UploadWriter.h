@@ -0,0 +1,39 @@
+#ifndef UPLOADWRITER_H_
+#define UPLOADWRITER_H_
+
+#include <memory>
+
+#include <FS.h>
+#include <WString.h>
+
+// Writes uploaded file to SPIFFS. Data comes from network in pieces of arbitrary size, so it is gathered in buffer of a
+// few SPIFFS pages and written to file in blocks, aligned to data pages (page without its header). Hash of content is
+// calculated on the fly, so file is not read again to get its ETag.
+class UploadWriter
+{
+public:
+    bool open(String const& path);
+    bool write(uint8_t const* data, size_t size);
+    // Write the rest of buffered data and close file
+    bool close();
+
+    String const& path() const;
+    size_t        size() const;
+    uint32_t      content_hash() const;
+    // Time since file is opened, ms
+    unsigned long elapsed_time() const;
+
+private:
+    bool flush();
+
+    File                       file_;
+    String                     path_;
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t                     buffer_capacity_{0};
+    size_t                     buffer_size_{0};
+    size_t                     size_{0};
+    uint32_t                   content_hash_{0};
+    unsigned long              open_time_{0};
+};
+
+#endif  // UPLOADWRITER_H_
@@ -1,19 +1,97 @@
 #include "WebServer.h"
 
+#include <algorithm>
 #include <cctype>
-#include <map>
+#include <limits>
+#include <memory>
+#include <vector>
 
 #include <ESP8266SSDP.h>
+#include <Updater.h>
 #include <WString.h>
+#include <WebResponseImpl.h>
 
+#include "FsBatch.h"
+#include "FsIndex.h"
+#include "UploadWriter.h"
+#include "WebUiBundle.h"
 #include "logger.h"
 
 namespace
 {
-static const char TEXT_PLAIN[] PROGMEM     = "text/plain";
-static const char TEXT_JSON[] PROGMEM      = "text/json";
-static const char FS_INIT_ERROR[] PROGMEM  = "FS INIT ERROR";
-static const char FILE_NOT_FOUND[] PROGMEM = "FileNotFound";
+static const char TEXT_PLAIN[] PROGMEM      = "text/plain";
+static const char TEXT_JSON[] PROGMEM       = "text/json";
+static const char FS_INIT_ERROR[] PROGMEM   = "FS INIT ERROR";
+static const char FILE_NOT_FOUND[] PROGMEM  = "FileNotFound";
+static const char IF_NONE_MATCH[] PROGMEM   = "If-None-Match";
+static const char ACCEPT_ENCODING[] PROGMEM = "Accept-Encoding";
+static const char RANGE[] PROGMEM           = "Range";
+static const char IF_RANGE[] PROGMEM        = "If-Range";
+
+// Content type and Cache-Control of files by extension. Pages, scripts and styles have no version in their names, so
+// browser should revalidate them on every load. Thanks to ETag it costs just "304 Not Modified" reply. Images are
+// changed rarely, so they are cached without revalidation
+struct FileType
+{
+    char const* extension;
+    char const* content_type;
+    char const* cache_control;
+};
+constexpr char no_cache[] PROGMEM      = "no-cache";
+constexpr char cache_for_day[] PROGMEM = "max-age=86400";
+constexpr char htm_extension[] PROGMEM = ".htm";
+constexpr char css_extension[] PROGMEM = ".css";
+constexpr char js_extension[] PROGMEM  = ".js";
+constexpr char jpg_extension[] PROGMEM = ".jpg";
+constexpr char gif_extension[] PROGMEM = ".gif";
+constexpr char ico_extension[] PROGMEM = ".ico";
+constexpr char png_extension[] PROGMEM = ".png";
+constexpr char txt_extension[] PROGMEM = ".txt";
+constexpr char gz_extension[] PROGMEM  = ".gz";
+constexpr char text_html[] PROGMEM     = "text/html";
+constexpr char text_css[] PROGMEM      = "text/css";
+constexpr char javascript[] PROGMEM    = "application/javascript";
+constexpr char image_jpeg[] PROGMEM    = "image/jpeg";
+constexpr char image_gif[] PROGMEM     = "image/gif";
+constexpr char image_icon[] PROGMEM    = "image/x-icon";
+constexpr char image_png[] PROGMEM     = "image/png";
+constexpr char gzip_archive[] PROGMEM  = "application/x-gzip";
+constexpr char binary_data[] PROGMEM   = "application/octet-stream";
+
+constexpr FileType file_types[] PROGMEM{{htm_extension, text_html, no_cache},
+                                        {css_extension, text_css, no_cache},
+                                        {js_extension, javascript, no_cache},
+                                        {jpg_extension, image_jpeg, cache_for_day},
+                                        {gif_extension, image_gif, cache_for_day},
+                                        {ico_extension, image_icon, cache_for_day},
+                                        {png_extension, image_png, cache_for_day},
+                                        {txt_extension, TEXT_PLAIN, no_cache},
+                                        {gz_extension, gzip_archive, no_cache}};
+
+// Names of OtaSession::State
+constexpr char ota_idle[] PROGMEM                     = "idle";
+constexpr char ota_running[] PROGMEM                  = "running";
+constexpr char ota_completed[] PROGMEM                = "completed";
+constexpr char const* const ota_state_names[] PROGMEM = {ota_idle, ota_running, ota_completed};
+
+// Returns nullptr if file type is unknown
+FileType const*
+find_file_type(String const& path)
+{
+    for (auto const& file_type : file_types) {
+        if (path.endsWith(FPSTR(pgm_read_ptr(&file_type.extension)))) {
+            return &file_type;
+        }
+    }
+    return nullptr;
+}
+
+PGM_P
+get_content_type(String const& path)
+{
+    auto file_type = find_file_type(path);
+    return (file_type != nullptr) ? static_cast<PGM_P>(pgm_read_ptr(&file_type->content_type)) : binary_data;
+}
 
 String
 check_for_unsupported_path(String const& filename)
@@ -38,7 +116,7 @@ check_for_unsupported_path(String const& filename)
 String
 last_existing_parent(String path)
 {
-    while (!path.isEmpty() && !SPIFFS.exists(path)) {
+    while (!path.isEmpty() && !FsIndex::instance().exists(path)) {
         if (path.lastIndexOf('/') > 0) {
             path = path.substring(0, path.lastIndexOf('/'));
         }
@@ -46,46 +124,242 @@ last_existing_parent(String path)
             path.clear();  // No slash => the top folder does not exist
         }
     }
-    DEBUG_PRINTLN(PSTR("Last existing parent: ") + path);
+    LOG_DEBUG(FS, PSTR("Last existing parent: %s\n"), path.c_str());
     return path;
 }
 
+// Returns Cache-Control value for file. Extension ".gz" or ".br" of precompressed files is ignored
+PGM_P
+get_cache_control(String path)
+{
+    if (path.endsWith(F(".gz")) || path.endsWith(F(".br"))) {
+        path.remove(path.length() - 3);
+    }
+    auto file_type = find_file_type(path);
+    return (file_type != nullptr) ? static_cast<PGM_P>(pgm_read_ptr(&file_type->cache_control)) : no_cache;
+}
+
+// Strong ETag from hash of content
+String
+make_etag(uint32_t content_hash)
+{
+    char etag[12];
+    snprintf_P(etag, sizeof(etag), PSTR("\"%08x\""), content_hash);
+    return etag;
+}
+
 bool
-case_insensitive_string_less(String const& str1, String const& str2)
+is_number(String const& str)
 {
-    // if (str1.length() < str2.length()) {
-    //     return true;
-    // }
-    // if (str2.length() < str1.length()) {
-    //     return false;
-    // }
-    auto min_size = (str1.length() < str2.length()) ? str1.length() : str2.length();
-    for (size_t i = 0; i < min_size; ++i) {
-        if (std::toupper(str1[i]) != std::toupper(str2[i])) {
-            return std::toupper(str1[i]) < std::toupper(str2[i]);
+    if (str.isEmpty()) {
+        return false;
+    }
+    for (size_t i = 0; i < str.length(); ++i) {
+        if (!isdigit(str[i])) {
+            return false;
         }
     }
-    return str1.length() < str2.length();
+    return true;
 }
 
-auto filename_less = [](String const& l, String const& r) {
-    // return std::lexicographical_compare(l.begin(), l.end(), r.begin(), r.end());
-    if ((l[0] == '/') && (r[0] != '/')) {
-        // "l" is directory
-        return true;
+enum class RangeType : uint8_t
+{
+    NONE = 0,  // Whole file should be sent
+    SATISFIABLE,
+    UNSATISFIABLE
+};
+
+// Parse "Range" header: "bytes=<first>-<last>", "bytes=<first>-" or "bytes=-<suffix length>". Only single range is
+// supported. Multiple ranges and malformed header are ignored, so whole file is sent, as HTTP allows
+RangeType
+parse_range(String const& range, size_t file_size, size_t& first, size_t& last)
+{
+    if (!range.startsWith(F("bytes="))) {
+        return RangeType::NONE;
     }
-    else if ((r[0] == '/') && (l[0] != '/')) {
-        // "r" is directory
-        return false;
+    auto spec = range.substring(6);
+    auto dash = spec.indexOf('-');
+    if ((dash == -1) || (spec.indexOf(',') != -1)) {
+        return RangeType::NONE;
+    }
+    auto first_str = spec.substring(0, dash);
+    auto last_str  = spec.substring(dash + 1);
+    first_str.trim();
+    last_str.trim();
+
+    if (first_str.isEmpty()) {
+        // The last N bytes of file
+        if (!is_number(last_str)) {
+            return RangeType::NONE;
+        }
+        size_t suffix_size = last_str.toInt();
+        if ((suffix_size == 0) || (file_size == 0)) {
+            return RangeType::UNSATISFIABLE;
+        }
+        first = file_size - std::min(suffix_size, file_size);
+        last  = file_size - 1;
+        return RangeType::SATISFIABLE;
+    }
+
+    if (!is_number(first_str) || (!last_str.isEmpty() && !is_number(last_str))) {
+        return RangeType::NONE;
+    }
+    first = first_str.toInt();
+    if (first >= file_size) {
+        return RangeType::UNSATISFIABLE;
+    }
+    last = last_str.isEmpty() ? (file_size - 1) : std::min(static_cast<size_t>(last_str.toInt()), file_size - 1);
+    return (last >= first) ? RangeType::SATISFIABLE : RangeType::NONE;
+}
+
+// Whether encoding is listed in Accept-Encoding header and is not refused with "q=0"
+bool
+is_encoding_accepted(String const& accept_encoding, PGM_P encoding)
+{
+    int start{0};
+    while (start < static_cast<int>(accept_encoding.length())) {
+        auto end = accept_encoding.indexOf(',', start);
+        if (end == -1) {
+            end = accept_encoding.length();
+        }
+        auto coding = accept_encoding.substring(start, end);
+        start       = end + 1;
+
+        auto parameters_start = coding.indexOf(';');
+        auto name             = (parameters_start == -1) ? coding : coding.substring(0, parameters_start);
+        name.trim();
+        if (!name.equalsIgnoreCase(FPSTR(encoding))) {
+            continue;
+        }
+        auto quality_start = coding.indexOf(F("q="), parameters_start);
+        return (parameters_start == -1) || (quality_start == -1) || (coding.substring(quality_start + 2).toFloat() > 0);
+    }
+    return false;
+}
+
+bool
+case_insensitive_string_less(char const* str1, char const* str2)
+{
+    for (; (*str1 != '\0') && (*str2 != '\0'); ++str1, ++str2) {
+        if (std::toupper(*str1) != std::toupper(*str2)) {
+            return std::toupper(*str1) < std::toupper(*str2);
+        }
+    }
+    return (*str1 == '\0') && (*str2 != '\0');
+}
+
+// Entry of directory listing. Names of all entries are kept in one buffer, so listing costs just a few bytes per entry
+// plus names themselves. Rendered JSON is never kept for more than one batch of entries
+struct FileListEntry
+{
+    uint16_t name_offset;  // Offset of null-terminated name without leading "/" in buffer of names
+    bool     is_directory;
+    uint32_t size;
+};
+
+// Directories go first, then files. Both are sorted by name, case-insensitive
+struct FileListEntryLess
+{
+    char const* names;
+
+    bool
+    operator()(FileListEntry const& l, FileListEntry const& r) const
+    {
+        if (l.is_directory != r.is_directory) {
+            return l.is_directory;
+        }
+        return case_insensitive_string_less(names + l.name_offset, names + r.name_offset);
+    }
+};
+
+// Sorted directory listing. It is rendered into JSON piece by piece, when web server asks for the next chunk of
+// response, so only a small part of rendered listing is kept in memory at once
+struct FileList
+{
+    std::vector<FileListEntry> entries;
+    std::vector<char>          names;
+    size_t                     next_entry;
+    size_t                     end_entry;
+    String                     pending_output;  // Rendered, but not sent yet
+    bool                       is_rendered;
+
+    size_t
+    fill(uint8_t* buffer, size_t max_size)
+    {
+        while ((pending_output.length() < max_size) && !is_rendered) {
+            if (next_entry == end_entry) {
+                pending_output += ']';
+                is_rendered = true;
+                break;
+            }
+
+            auto const& entry = entries[next_entry++];
+            pending_output += F("{\"type\":\"");
+            if (entry.is_directory) {
+                // There is no directories on SPIFFS. This code is here for compatibility with another (possible)
+                // filesystems
+                pending_output += F("dir");
+            }
+            else {
+                pending_output += F("file\",\"size\":\"");
+                pending_output += entry.size;
+            }
+            pending_output += F("\",\"name\":\"");
+            pending_output += &names[entry.name_offset];
+            pending_output += F("\"}");
+            if (next_entry != end_entry) {
+                pending_output += ',';
+            }
+        }
+
+        auto size = std::min(max_size, static_cast<size_t>(pending_output.length()));
+        memcpy(buffer, pending_output.c_str(), size);
+        pending_output.remove(0, size);
+        return size;
+    }
+};
+
+// Error of upload is kept in request until upload is finished, because there is no way to stop client from uploading.
+// Request frees it with free()
+void
+set_upload_error(AsyncWebServerRequest* request, PGM_P error)
+{
+    if (request->_tempObject != nullptr) {
+        // Report the first error
+        return;
     }
-    else if ((l[0] == '/') && (r[0] == '/')) {
-        // Both strings are directory names
-        return case_insensitive_string_less(l.substring(1), r.substring(1));
+    auto size            = strlen_P(error) + 1;
+    request->_tempObject = malloc(size);
+    if (request->_tempObject != nullptr) {
+        memcpy_P(request->_tempObject, error, size);
+    }
+}
+
+// ESPAsyncWebServer adds "Accept-Ranges: none" to head of every HTTP/1.1 response. Files are served with support of
+// "Range" requests, so this header is replaced in assembled head instead of adding the second, contradicting one
+template <typename Response>
+class RangeResponse : public Response
+{
+public:
+    using Response::Response;
+
+    String
+    _assembleHead(uint8_t version) override
+    {
+        String head = Response::_assembleHead(version);
+        head.replace(String(F("Accept-Ranges: none")), String(F("Accept-Ranges: bytes")));
+        return head;
     }
-    // Regular file names
-    return case_insensitive_string_less(l, r);
 };
 
+// Maximal size of request with batch of file system operations
+constexpr size_t max_batch_size{4 * 1024};
+// Batches, which are received, but not run yet. Others are rejected
+constexpr size_t max_pending_batches{4};
+
+// Delay of deferred events, so response is sent to client before event is handled
+constexpr unsigned long event_delay{500};
+
 }  // namespace
 
 WebServer::WebServer()
@@ -99,78 +373,187 @@ WebServer::WebServer()
 void
 WebServer::init()
 {
+    // Complete or drop update of files, interrupted by reboot
+    fs_update_.init();
+
     // SSDP description
-    web_server_.on(F("/description.xml"), HTTP_GET, [this]() { SSDP.schema(web_server_.client()); });
+    web_server_.on("/description.xml", HTTP_GET, [](AsyncWebServerRequest* request) {
+        AsyncResponseStream* response = request->beginResponseStream(F("text/xml"));
+        SSDP.schema(*response);
+        request->send(response);
+    });
 
     // HTTP pages to work with file system
     // List directory
-    web_server_.on(F("/list"), HTTP_GET, [this]() { handle_file_list(); });
+    web_server_.on("/list", HTTP_GET, [this](AsyncWebServerRequest* request) { handle_file_list(request); });
     // Load editor
-    web_server_.on(F("/edit"), HTTP_GET, [this]() {
-        if (!handle_file_read(F("/edit.htm"))) {
-            reply_not_found(FPSTR(FILE_NOT_FOUND));
+    web_server_.on("/edit", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        if (!handle_file_read(request, F("/edit.htm"))) {
+            reply_not_found(request, FPSTR(FILE_NOT_FOUND));
         }
     });
     // Create file
-    web_server_.on(F("/edit"), HTTP_PUT, [this]() { handle_file_create(); });
+    web_server_.on("/edit", HTTP_PUT, [this](AsyncWebServerRequest* request) { handle_file_create(request); });
     // Delete file
-    web_server_.on(F("/edit"), HTTP_DELETE, [this]() { handle_file_delete(); });
+    web_server_.on("/edit", HTTP_DELETE, [this](AsyncWebServerRequest* request) { handle_file_delete(request); });
 
     // Upload file
     // - first callback is called after the request has ended with all parsed arguments
     // - second callback handles file upload at that location
     web_server_.on(
-        F("/edit"), HTTP_POST, [this]() { reply_ok(); }, [this]() { handle_file_upload(); });
+        "/edit",
+        HTTP_POST,
+        [this](AsyncWebServerRequest* request) {
+            if (request->_tempObject != nullptr) {
+                reply_server_error(request, static_cast<char const*>(request->_tempObject));
+                return;
+            }
+            reply_ok(request);
+        },
+        [this](AsyncWebServerRequest* request,
+               String const&          filename,
+               size_t                 index,
+               uint8_t*               data,
+               size_t                 size,
+               bool                   is_final) {
+            handle_file_upload(request, filename, index, data, size, is_final);
+        });
+
+    // Run several file system operations in one request, see FsBatch. Body should be sent as "application/json"
+    web_server_.on(
+        "/batch",
+        HTTP_POST,
+        [this](AsyncWebServerRequest* request) { handle_batch(request); },
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index, size_t total) {
+            handle_batch_body(request, data, size, index, total);
+        });
 
     // Called when the url is not defined here
     // Use it to load content from SPIFFS
-    web_server_.onNotFound([this]() {
-        if (!handle_file_read(web_server_.uri())) {
-            reply_not_found(FPSTR(FILE_NOT_FOUND));
+    web_server_.onNotFound([this](AsyncWebServerRequest* request) {
+        if (!handle_file_read(request, request->url())) {
+            reply_not_found(request, FPSTR(FILE_NOT_FOUND));
         }
     });
 
     // HTTP pages for Settings
     // Update ESP firmware
     web_server_.on(
-        F("/update"),
+        "/update",
         HTTP_POST,
-        [this]() {
-            // This code is from example. Not sure if we really need it
-            //
-            // web_server_.sendHeader(F("Connection"), F("close"));
-            // web_server_.sendHeader(F("Access-Control-Allow-Origin"), "*");
-            // reply_ok_with_msg(Update.hasError() ? F("FAIL") : F("ESP firmware update completed! Rebooting..."));
-
+        [this](AsyncWebServerRequest* request) {
             // If there were errors during uploading of file, this is the only place, where we can send message to
             // client about it
             if (esp_firmware_upload_error_.length() != 0) {
-                DEBUG_PRINTLN(PSTR("Sending error to WebUI: ") + esp_firmware_upload_error_);
-                reply_server_error(esp_firmware_upload_error_);
+                LOG_ERROR(WEB, PSTR("Sending error to WebUI: %s\n"), esp_firmware_upload_error_.c_str());
+                reply_server_error(request, esp_firmware_upload_error_);
                 esp_firmware_upload_error_ = "";
             }
             else {
-                reply_ok_with_msg(F("ESP firmware update completed! Rebooting..."));
-                DEBUG_PRINTLN(F("Rebooting..."));
+                reply_ok_with_msg(request, F("ESP firmware update completed! Rebooting..."));
+                LOG_INFO(WEB, PSTR("Rebooting...\n"));
                 handle_reboot_esp();  // Schedule reboot
             }
         },
-        [this]() { handle_esp_sw_upload(); });
+        [this](AsyncWebServerRequest* request,
+               String const&          filename,
+               size_t                 index,
+               uint8_t*               data,
+               size_t                 size,
+               bool                   is_final) {
+            handle_esp_sw_upload(request, filename, index, data, size, is_final);
+        });
+
+    // Resumable update of ESP firmware:
+    // - "POST /ota/begin?size=<size>[&image_size=<size>][&md5=<hex>][&sha256=<hex>]" starts update or continues the
+    //   same one. Update is continued only if it was started with hash. Image can be compressed with gzip, then
+    //   "image_size" is its size after inflating
+    // - "POST /ota/chunk?offset=<offset>" with raw data in body writes part of image
+    // - "GET /ota" replies status of update, so client knows, where to continue from
+    // - "DELETE /ota" aborts update
+    // Status is JSON {"state":"idle|running|completed","size":<size>,"offset":<committed size>,"error":"<error>"}
+    web_server_.on("/ota", HTTP_GET, [this](AsyncWebServerRequest* request) { reply_ota_status(request); });
+    web_server_.on("/ota", HTTP_DELETE, [this](AsyncWebServerRequest* request) {
+        ota_.abort();
+        reply_ota_status(request);
+    });
+    web_server_.on("/ota/begin", HTTP_POST, [this](AsyncWebServerRequest* request) { handle_ota_begin(request); });
+    web_server_.on(
+        "/ota/chunk",
+        HTTP_POST,
+        [this](AsyncWebServerRequest* request) { handle_ota_chunk_end(request); },
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index, size_t total) {
+            handle_ota_chunk(request, data, size, index);
+        });
+
+    // Update of set of files, ex. new version of web UI (see tools/update_data.py):
+    // - "POST /fs_update" with manifest in body replies JSON {"files":[<paths of files, which should be uploaded>]}
+    // - "POST /fs_update/file?path=<path>" with raw content of file in body uploads file
+    // - "POST /fs_update/commit" replaces all changed files at once
+    // - "DELETE /fs_update" drops uploaded files
+    // Handlers of "/fs_update" match "/fs_update/..." as well, so they are registered after more specific ones
+    web_server_.on(
+        "/fs_update/file",
+        HTTP_POST,
+        [this](AsyncWebServerRequest* request) { handle_fs_update_file_end(request); },
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index, size_t total) {
+            handle_fs_update_file(request, data, size, index, total);
+        });
+    web_server_.on("/fs_update/commit", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        handle_fs_update_commit(request);
+    });
+    web_server_.on(
+        "/fs_update",
+        HTTP_POST,
+        [this](AsyncWebServerRequest* request) { handle_fs_update_begin(request); },
+        nullptr,
+        [this](AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index, size_t total) {
+            handle_fs_update_manifest(request, data, size, index);
+        });
+    web_server_.on("/fs_update", HTTP_DELETE, [this](AsyncWebServerRequest* request) {
+        fs_update_.abort();
+        reply_ok(request);
+    });
+
+    // Cached state of lamp:
+    // - "GET /api/state" replies all fields {"<field>":{"value":<value>,"updated":<uptime, s>},...}
+    // - "GET /api/state/<field>" replies one field {"value":<value>,"updated":<uptime, s>}
+    // Value of field, which is not received from Arduino, is null. "Age" header is age of the oldest field in reply
+    web_server_.on("/api/state", HTTP_GET, [this](AsyncWebServerRequest* request) { handle_api_state(request); });
 
-    web_server_.on(F("/reset_wifi_settings"), HTTP_POST, [this]() { handle_reset_wifi_settings(); });
-    web_server_.on(F("/reboot_esp"), HTTP_POST, [this]() {
-        reply_ok();
+    web_server_.on("/reset_wifi_settings", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        handle_reset_wifi_settings(request);
+    });
+    web_server_.on("/reboot_esp", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        reply_ok(request);
         handle_reboot_esp();
     });
 
     web_server_.begin();
-    DEBUG_PRINTLN(F("Web server initialized"));
+    LOG_INFO(WEB, PSTR("Web server initialized. Web UI bundle has %u pages\n"), WebUiBundle::size());
 }
 
 void
 WebServer::loop()
 {
-    web_server_.handleClient();
+    // Requests are served by web server in background. Here only work, which can not be done inside of request
+    // handlers, is done: operations of batches, which take time, and events
+    run_batches();
+
+    if ((pending_events_ == 0) || (millis() - pending_events_time_ < event_delay)) {
+        return;
+    }
+
+    auto events     = pending_events_;
+    pending_events_ = 0;
+    for (size_t i = 0; i < handlers_.size(); ++i) {
+        if (((events & (1 << i)) != 0) && (handlers_[i] != nullptr)) {
+            handlers_[i]("");
+        }
+    }
 }
 
 void
@@ -180,115 +563,104 @@ WebServer::set_handler(Event event, EventHandler handler)
 }
 
 void
-WebServer::reply_ok()
+WebServer::reply_ok(AsyncWebServerRequest* request)
 {
-    web_server_.send(200, FPSTR(TEXT_PLAIN), "");
+    request->send(200, FPSTR(TEXT_PLAIN), "");
 }
 
 void
-WebServer::reply_ok_with_msg(String const& msg)
+WebServer::reply_ok_with_msg(AsyncWebServerRequest* request, String const& msg)
 {
-    web_server_.send(200, FPSTR(TEXT_PLAIN), msg);
+    request->send(200, FPSTR(TEXT_PLAIN), msg);
 }
 
 void
-WebServer::reply_ok_json_with_msg(String const& msg)
+WebServer::reply_ok_json_with_msg(AsyncWebServerRequest* request, String const& msg)
 {
-    web_server_.send(200, FPSTR(TEXT_JSON), msg);
+    request->send(200, FPSTR(TEXT_JSON), msg);
 }
 
 void
-WebServer::reply_not_found(String const& msg)
+WebServer::reply_not_found(AsyncWebServerRequest* request, String const& msg)
 {
-    web_server_.send(404, FPSTR(TEXT_PLAIN), msg);
+    request->send(404, FPSTR(TEXT_PLAIN), msg);
 }
 
 void
-WebServer::reply_bad_request(String const& msg)
+WebServer::reply_bad_request(AsyncWebServerRequest* request, String const& msg)
 {
-    DEBUG_PRINTLN(msg);
-    web_server_.send(400, FPSTR(TEXT_PLAIN), msg + "\r\n");
+    LOG_WARNING(WEB, PSTR("%s\n"), msg.c_str());
+    request->send(400, FPSTR(TEXT_PLAIN), msg + "\r\n");
 }
 
 void
-WebServer::reply_server_error(String const& msg)
+WebServer::reply_server_error(AsyncWebServerRequest* request, String const& msg)
 {
-    DEBUG_PRINTLN(msg);
-    web_server_.send(500, FPSTR(TEXT_PLAIN), msg + "\r\n");
+    LOG_ERROR(WEB, PSTR("%s\n"), msg.c_str());
+    request->send(500, FPSTR(TEXT_PLAIN), msg + "\r\n");
 }
 
+// Optional "offset" and "limit" arguments select part of sorted listing, so very large directories can be read page by
+// page. Total number of entries is returned in "X-Total-Count" header
 void
-WebServer::handle_file_list()
+WebServer::handle_file_list(AsyncWebServerRequest* request)
 {
-    if (!web_server_.hasArg(F("dir"))) {
-        reply_bad_request(F("DIR ARG MISSING"));
+    if (!request->hasArg(F("dir"))) {
+        return reply_bad_request(request, F("DIR ARG MISSING"));
+    }
+    String path{request->arg(F("dir"))};
+    if (path != "/" && !FsIndex::instance().exists(path)) {
+        return reply_bad_request(request, F("BAD PATH"));
+    }
+    size_t offset{0};
+    size_t limit{std::numeric_limits<size_t>::max()};
+    if (request->hasArg(F("offset"))) {
+        offset = request->arg(F("offset")).toInt();
     }
-    String path{web_server_.arg(F("dir"))};
-    if (path != "/" && !SPIFFS.exists(path)) {
-        return reply_bad_request(F("BAD PATH"));
+    if (request->hasArg(F("limit"))) {
+        limit = request->arg(F("limit")).toInt();
     }
 
-    DEBUG_PRINTLN(PSTR("handle_file_list: ") + path);
+    LOG_DEBUG(FS, PSTR("handle_file_list: %s\n"), path.c_str());
     Dir dir = SPIFFS.openDir(path);
 
-    // Use HTTP/1.1 Chunked response to avoid building a huge temporary string
-    if (!web_server_.chunkedResponseModeStart(200, FPSTR(TEXT_JSON))) {
-        web_server_.send(505, F("text/html"), F("HTTP1.1 required"));
-        return;
-    }
-
-    // Use the same string for every line
-    String                                            output;
-    String                                            name;
-    std::map<String, String, decltype(filename_less)> files_data(filename_less);
-    output.reserve(64);
+    // Collect compact sort index. Only names are copied, JSON is rendered after sorting, piece by piece.
+    // NOTE: SPIFFS doesn't support directories! Path <directory_name/filename> can exist, but directory, as entity,
+    // not. Directories are used just as part of path.
+    auto file_list = std::make_shared<FileList>();
     while (dir.next()) {
-        String error{check_for_unsupported_path(dir.fileName())};
+        String file_name{dir.fileName()};
+        String error{check_for_unsupported_path(file_name)};
         if (error.length() > 0) {
-            DEBUG_PRINTLN(PSTR("Ignoring ") + error + dir.fileName());
+            LOG_WARNING(FS, PSTR("Ignoring %s%s\n"), error.c_str(), file_name.c_str());
             continue;
         }
-
-        output += F("{\"type\":\"");
-        if (dir.isDirectory()) {
-            // There is no directories on SPIFFS. This code is here for compatibility with another (possible)
-            // filesystems
-            output += PSTR("dir");
-        }
-        else {
-            output += F("file\",\"size\":\"");
-            output += dir.fileSize();
+        if (file_list->names.size() + file_name.length() > std::numeric_limits<uint16_t>::max()) {
+            LOG_WARNING(FS, PSTR("Listing of %s is too long. Ignoring %s\n"), path.c_str(), file_name.c_str());
+            continue;
         }
 
-        output += F("\",\"name\":\"");
         // Always return names without leading "/"
-        if (dir.fileName()[0] == '/') {
-            output += &(dir.fileName()[1]);
-            name = dir.fileName();  // name in map should contain leading "/"
-        }
-        else {
-            output += dir.fileName();
-            name = '/' + dir.fileName();  // name in map should contain leading "/"
-        }
-
-        output += "\"}";
-
-        files_data.insert(std::make_pair(name, output));
-        output.clear();
+        file_list->entries.push_back(
+            {static_cast<uint16_t>(file_list->names.size()), dir.isDirectory(), dir.fileSize()});
+        file_list->names.insert(
+            file_list->names.end(), file_name.c_str() + 1, file_name.c_str() + file_name.length() + 1);
     }
+    std::sort(file_list->entries.begin(), file_list->entries.end(), FileListEntryLess{file_list->names.data()});
 
-    // Sort file list before building output.
-    // NOTE: SPIFFS doesn't support directories! Path <directory_name/filename> can exist, but directory, as entoty,
-    // not. Directories are used just as part of path.
-    output = '[';
-    for (auto const& data_pair : files_data) {
-        output += data_pair.second + ',';
-    }
-    output.remove(output.length() - 1);
-    output += ']';
+    auto num_of_entries       = file_list->entries.size();
+    file_list->next_entry     = std::min(offset, num_of_entries);
+    file_list->end_entry      = file_list->next_entry + std::min(limit, num_of_entries - file_list->next_entry);
+    file_list->pending_output = '[';
+    file_list->is_rendered    = false;
 
-    web_server_.sendContent(output);
-    web_server_.chunkedResponseFinalize();
+    // Use HTTP/1.1 Chunked response to avoid building a huge temporary string
+    AsyncWebServerResponse* response = request->beginChunkedResponse(
+        FPSTR(TEXT_JSON), [file_list](uint8_t* buffer, size_t max_size, size_t) {
+            return file_list->fill(buffer, max_size);
+        });
+    response->addHeader(F("X-Total-Count"), String(num_of_entries));
+    request->send(response);
 }
 
 
@@ -304,35 +676,35 @@ WebServer::handle_file_list()
    Move folder    | parent of source folder, or remaining ancestor
 */
 void
-WebServer::handle_file_create()
+WebServer::handle_file_create(AsyncWebServerRequest* request)
 {
-    if (!web_server_.hasArg(F("path"))) {
-        reply_bad_request(F("PATH ARG MISSING"));
+    if (!request->hasArg(F("path"))) {
+        return reply_bad_request(request, F("PATH ARG MISSING"));
     }
 
-    String path{web_server_.arg(F("path"))};
+    String path{request->arg(F("path"))};
     if (path.isEmpty()) {
-        return reply_bad_request(F("PATH ARG MISSING"));
+        return reply_bad_request(request, F("PATH ARG MISSING"));
     }
     if (check_for_unsupported_path(path).length() > 0) {
-        return reply_server_error(F("INVALID FILENAME"));
+        return reply_server_error(request, F("INVALID FILENAME"));
     }
     if (path == "/") {
-        return reply_bad_request(F("BAD PATH"));
+        return reply_bad_request(request, F("BAD PATH"));
     }
-    if (SPIFFS.exists(path)) {
-        return reply_bad_request(F("FILE EXISTS"));
+    if (FsIndex::instance().exists(path)) {
+        return reply_bad_request(request, F("FILE EXISTS"));
     }
 
-    String src = web_server_.arg(F("src"));
+    String src = request->arg(F("src"));
     if (src.isEmpty()) {
         // No source specified: creation
-        DEBUG_PRINTLN(PSTR("handle_file_create: ") + path);
+        LOG_INFO(FS, PSTR("handle_file_create: %s\n"), path.c_str());
         if (path.endsWith("/")) {
             // Create a folder
             path.remove(path.length() - 1);
             if (!SPIFFS.mkdir(path)) {
-                return reply_server_error(F("MKDIR FAILED"));
+                return reply_server_error(request, F("MKDIR FAILED"));
             }
         }
         else {
@@ -341,26 +713,28 @@ WebServer::handle_file_create()
             if (file) {
                 file.write((const char*)0);
                 file.close();
+                FsIndex::instance().update(path);
+                FsBatch::remove_variants(path);
             }
             else {
-                return reply_server_error(F("CREATE FAILED"));
+                return reply_server_error(request, F("CREATE FAILED"));
             }
         }
         if (path.lastIndexOf('/') > -1) {
             path = path.substring(0, path.lastIndexOf('/'));
         }
-        reply_ok_with_msg(path);
+        reply_ok_with_msg(request, path);
     }
     else {
         // Source specified: rename
         if (src == "/") {
-            return reply_bad_request(F("BAD SRC"));
+            return reply_bad_request(request, F("BAD SRC"));
         }
-        if (!SPIFFS.exists(src)) {
-            return reply_bad_request(F("SRC FILE NOT FOUND"));
+        if (!FsIndex::instance().exists(src)) {
+            return reply_bad_request(request, F("SRC FILE NOT FOUND"));
         }
 
-        DEBUG_PRINTLN(PSTR("handle_file_create: ") + path + PSTR(" from ") + src);
+        LOG_INFO(FS, PSTR("handle_file_create: %s from %s\n"), path.c_str(), src.c_str());
 
         if (path.endsWith("/")) {
             path.remove(path.length() - 1);
@@ -369,161 +743,376 @@ WebServer::handle_file_create()
             src.remove(src.length() - 1);
         }
         if (!SPIFFS.rename(src, path)) {
-            return reply_server_error(F("RENAME FAILED"));
+            return reply_server_error(request, F("RENAME FAILED"));
         }
-        reply_ok_with_msg(last_existing_parent(src));
+        FsIndex::instance().rename(src, path);
+        FsBatch::remove_variants(src);
+        FsBatch::remove_variants(path);
+        reply_ok_with_msg(request, last_existing_parent(src));
     }
 }
 
 
 /*
-   Delete the file or folder designed by the given path.
-   If it's a file, delete it.
-   If it's a folder, delete all nested contents first then the folder itself
-
-   IMPORTANT NOTE: using recursion is generally not recommended on embedded devices and can lead to crashes
-   (stack overflow errors). It might crash in case of deeply nested filesystems.
-   Please don't do this on a production system.
+   Handle a file deletion request
+   Operation      | req.responseText
+   ---------------+--------------------------------------------------------------
+   Delete file    | parent of deleted file, or remaining ancestor
+   Delete folder  | parent of deleted folder, or remaining ancestor
 */
 void
-WebServer::delete_recursive(String const& path)
+WebServer::handle_file_delete(AsyncWebServerRequest* request)
 {
-    File file  = SPIFFS.open(path, "r");
-    bool isDir = file.isDirectory();
-    file.close();
-
-    // If it's a plain file, delete it
-    if (!isDir) {
-        SPIFFS.remove(path);
-        return;
+    if (request->args() == 0) {
+        return reply_server_error(request, F("BAD ARGS"));
+    }
+    String path{request->arg(0)};
+    if (path.isEmpty() || path == "/") {
+        return reply_bad_request(request, F("BAD PATH"));
     }
 
-    // Otherwise delete its contents first
-    Dir dir = SPIFFS.openDir(path);
-    while (dir.next()) {
-        delete_recursive(path + '/' + dir.fileName());
+    LOG_INFO(FS, PSTR("handle_file_delete: %s\n"), path.c_str());
+
+    if (!FsIndex::instance().exists(path)) {
+        return reply_not_found(request, FPSTR(FILE_NOT_FOUND));
     }
+    FsBatch::delete_tree(path);
+    FsBatch::remove_variants(path);
 
-    // Then delete the folder itself
-    SPIFFS.rmdir(path);
+    reply_ok_with_msg(request, last_existing_parent(path));
 }
 
-/*
-   Handle a file deletion request
-   Operation      | req.responseText
-   ---------------+--------------------------------------------------------------
-   Delete file    | parent of deleted file, or remaining ancestor
-   Delete folder  | parent of deleted folder, or remaining ancestor
-*/
 void
-WebServer::handle_file_delete()
+WebServer::handle_batch_body(AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index, size_t total)
 {
-    if (web_server_.args() == 0) {
-        reply_server_error(F("BAD ARGS"));
+    // Body is collected in request and freed with it. Too big body is ignored
+    if (total > max_batch_size) {
         return;
     }
-    String path{web_server_.arg(0)};
-    if (path.isEmpty() || path == "/") {
-        return reply_bad_request(F("BAD PATH"));
+    if (index == 0) {
+        request->_tempObject = malloc(total + 1);
+        if (request->_tempObject != nullptr) {
+            static_cast<char*>(request->_tempObject)[total] = '\0';
+        }
     }
-
-    DEBUG_PRINTLN(PSTR("handle_file_delete: ") + path);
-
-    if (!SPIFFS.exists(path)) {
-        return reply_not_found(FPSTR(FILE_NOT_FOUND));
+    if (request->_tempObject != nullptr) {
+        memcpy(static_cast<char*>(request->_tempObject) + index, data, size);
     }
-    delete_recursive(path);
+}
 
-    reply_ok_with_msg(last_existing_parent(path));
+void
+WebServer::handle_batch(AsyncWebServerRequest* request)
+{
+    if (request->_tempObject == nullptr) {
+        return reply_bad_request(request, F("BAD BATCH"));
+    }
+    auto batch = std::make_shared<FsBatch>();
+    if (!batch->parse(static_cast<char const*>(request->_tempObject))) {
+        return reply_bad_request(request, F("BAD BATCH"));
+    }
+    if (batches_.size() >= max_pending_batches) {
+        LOG_WARNING(FS, PSTR("handle_batch: too many pending batches\n"));
+        request->send(503, FPSTR(TEXT_PLAIN), F("BUSY"));
+        return;
+    }
+    LOG_INFO(FS, PSTR("handle_batch: %u operations\n"), batch->num_of_operations());
+
+    // Operations are run from loop(), one per pass, so web server and other servers are not blocked by long batch
+    batches_.push_back({request, batch});
+    request->onDisconnect([this, request]() {
+        for (auto& pending : batches_) {
+            if (pending.request == request) {
+                pending.request = nullptr;
+            }
+        }
+    });
 }
 
 void
-WebServer::handle_file_upload()
+WebServer::run_batches()
 {
-    if (web_server_.uri() != F("/edit")) {
+    if (batches_.empty() || batches_.front().batch->run_next()) {
+        return;
+    }
+
+    auto pending = batches_.front();
+    batches_.erase(batches_.begin());
+    if (pending.request == nullptr) {
+        LOG_WARNING(FS, PSTR("Batch is done, but client has disconnected\n"));
         return;
     }
+    // Results are rendered, while they are sent
+    auto                    batch    = pending.batch;
+    AsyncWebServerResponse* response = pending.request->beginChunkedResponse(
+        FPSTR(TEXT_JSON), [batch](uint8_t* buffer, size_t max_size, size_t) { return batch->fill(buffer, max_size); });
+    pending.request->send(response);
+}
 
-    HTTPUpload& upload = web_server_.upload();
-    if (upload.status == UPLOAD_FILE_START) {
-        String filename = upload.filename;
+void
+WebServer::handle_file_upload(AsyncWebServerRequest* request,
+                              String const&          filename,
+                              size_t                 index,
+                              uint8_t*               data,
+                              size_t                 size,
+                              bool                   is_final)
+{
+    // Every request has its own writer, so several files can be uploaded at once
+    if (index == 0) {
+        String path{filename};
         // Make sure paths always start with "/"
-        if (!filename.startsWith("/")) {
-            filename = "/" + filename;
+        if (!path.startsWith("/")) {
+            path = "/" + path;
         }
-        DEBUG_PRINTLN(PSTR("handle_file_upload Name: ") + filename);
-        upload_file_ = SPIFFS.open(filename, "w");
-        if (!upload_file_) {
-            return reply_server_error(F("CREATE FAILED"));
+        LOG_DEBUG(FS, PSTR("handle_file_upload Name: %s\n"), path.c_str());
+        std::unique_ptr<UploadWriter> writer{new UploadWriter};
+        if (!writer->open(path)) {
+            return set_upload_error(request, PSTR("CREATE FAILED"));
         }
-        DEBUG_PRINTLN(PSTR("Upload: START, filename: ") + filename);
+        uploads_.push_back({request, std::move(writer)});
+        // Writer of aborted upload is dropped, when client disconnects
+        request->onDisconnect([this, request]() { remove_upload(request); });
+        LOG_INFO(FS, PSTR("Upload: START, filename: %s\n"), path.c_str());
     }
-    else if (upload.status == UPLOAD_FILE_WRITE) {
-        if (upload_file_) {
-            size_t bytesWritten = upload_file_.write(upload.buf, upload.currentSize);
-            if (bytesWritten != upload.currentSize) {
-                return reply_server_error(F("WRITE FAILED"));
-            }
-        }
-        DEBUG_PRINTLN(PSTR("Upload: WRITE, Bytes: ") + String(upload.currentSize));
+
+    auto writer = find_upload(request);
+    if (writer == nullptr) {
+        return;
+    }
+    if ((size != 0) && !writer->write(data, size)) {
+        set_upload_error(request, PSTR("WRITE FAILED"));
     }
-    else if (upload.status == UPLOAD_FILE_END) {
-        if (upload_file_) {
-            upload_file_.close();
+
+    if (is_final) {
+        auto is_written = writer->close();
+        if (!is_written) {
+            set_upload_error(request, PSTR("WRITE FAILED"));
         }
-        DEBUG_PRINTLN(PSTR("Upload: END, Size: ") + String(upload.totalSize));
+        // Hash of content is known only if all data is written
+        FsIndex::instance().update(writer->path(), is_written ? writer->content_hash() : 0);
+        FsBatch::remove_variants(writer->path());
+        auto elapsed_time = std::max(writer->elapsed_time(), 1UL);
+        LOG_INFO(FS,
+                 PSTR("Upload: END, %s, %u bytes in %lu ms (%lu KB/s)\n"),
+                 writer->path().c_str(),
+                 writer->size(),
+                 elapsed_time,
+                 writer->size() / elapsed_time);
+        remove_upload(request);
     }
 }
 
+UploadWriter*
+WebServer::find_upload(AsyncWebServerRequest* request)
+{
+    auto it = std::find_if(
+        uploads_.begin(), uploads_.end(), [request](Upload const& upload) { return upload.request == request; });
+    return (it != uploads_.end()) ? it->writer.get() : nullptr;
+}
+
+void
+WebServer::remove_upload(AsyncWebServerRequest* request)
+{
+    uploads_.erase(std::remove_if(uploads_.begin(),
+                                  uploads_.end(),
+                                  [request](Upload const& upload) { return upload.request == request; }),
+                   uploads_.end());
+}
+
 bool
-WebServer::handle_file_read(String path)
+WebServer::handle_file_read(AsyncWebServerRequest* request, String path)
 {
-    DEBUG_PRINTLN(PSTR("handle_file_read: ") + path);
+    LOG_DEBUG(WEB, PSTR("handle_file_read: %s\n"), path.c_str());
 
     if (path.endsWith("/")) {
         path += F("index.htm");
     }
 
     String contentType;
-    if (web_server_.hasArg(F("download"))) {
-        contentType = F("application/octet-stream");
+    String accept_encoding;
+    bool   is_download = request->hasArg(F("download"));
+    if (is_download) {
+        // Download original file, not its compressed variant
+        contentType = FPSTR(binary_data);
     }
     else {
-        contentType = mime::getContentType(path);
+        contentType     = FPSTR(get_content_type(path));
+        accept_encoding = request->header(FPSTR(ACCEPT_ENCODING));
+    }
+
+    // Look for file in index, so request for static asset doesn't scan flash. Precompressed variants, produced by
+    // tools/compress_data.py, are preferred if client accepts them: brotli, then gzip, then original file. If there is
+    // only gzip variant (ex. edit.htm.gz), it is sent to any client
+    auto&  fs_index = FsIndex::instance();
+    String file_path{path};
+    String br_path{path + F(".br")};
+    String gz_path{path + F(".gz")};
+    bool   has_br_variant = fs_index.exists(br_path);
+    bool   has_gz_variant = fs_index.exists(gz_path);
+    bool   is_br          = false;
+    if (has_br_variant && is_encoding_accepted(accept_encoding, PSTR("br"))) {
+        file_path = br_path;
+        is_br     = true;
+    }
+    else if (has_gz_variant && is_encoding_accepted(accept_encoding, PSTR("gzip"))) {
+        file_path = gz_path;
+    }
+    else if (!fs_index.exists(path)) {
+        if (!has_gz_variant) {
+            // Page is not overridden on SPIFFS. Try to serve it from firmware
+            return handle_bundled_file_read(request, path, contentType);
+        }
+        file_path = gz_path;
+    }
+    // Caches should keep different variants of the same URL
+    bool has_variants = has_br_variant || has_gz_variant;
+
+    // Hash of content is calculated once and cached in index until file is rewritten through "/edit" or FTP client
+    // connects or disconnects
+    auto etag = make_etag(fs_index.content_hash(file_path));
+    if (reply_not_modified(request, path, etag, has_variants)) {
+        return true;
     }
 
-    if (!SPIFFS.exists(path)) {
-        // File not found, try gzip version
-        path = path + F(".gz");
+    File file = SPIFFS.open(file_path, "r");
+    if (!file) {
+        // Index is out of date
+        fs_index.update(file_path);
+        return false;
     }
-    if (SPIFFS.exists(path)) {
-        File file = SPIFFS.open(path, "r");
-        if (web_server_.streamFile(file, contentType) != file.size()) {
-            DEBUG_PRINTLN(F("Sent less data than expected!"));
+
+    // Interrupted download can be resumed with "Range" request. Range is ignored if "If-Range" shows, that client has
+    // another version of file
+    size_t file_size = file.size();
+    size_t first{0};
+    size_t last{0};
+    auto   range_type = RangeType::NONE;
+    if (request->hasHeader(FPSTR(RANGE))) {
+        String if_range{request->header(FPSTR(IF_RANGE))};
+        if (if_range.isEmpty() || (if_range == etag)) {
+            range_type = parse_range(request->header(FPSTR(RANGE)), file_size, first, last);
         }
+    }
+    if (range_type == RangeType::UNSATISFIABLE) {
         file.close();
+        LOG_WARNING(WEB, PSTR("Range \"%s\" is out of %s\n"), request->header(FPSTR(RANGE)).c_str(), path.c_str());
+        AsyncWebServerResponse* response = new RangeResponse<AsyncBasicResponse>(416);
+        response->addHeader(F("Content-Range"), PSTR("bytes */") + String(file_size));
+        request->send(response);
         return true;
     }
 
-    return false;
+    // File is sent in background, piece by piece, when there is free space in TCP window
+    AsyncWebServerResponse* response;
+    if (range_type == RangeType::SATISFIABLE) {
+        LOG_DEBUG(WEB, PSTR("Sending bytes %u-%u of %s\n"), first, last, file_path.c_str());
+        // Only requested part of file is read
+        size_t range_size = last - first + 1;
+        auto   fill_range = [file, first, range_size](uint8_t* buffer, size_t max_size, size_t index) mutable {
+            file.seek(first + index);
+            return file.read(buffer, std::min(max_size, range_size - index));
+        };
+        response = new RangeResponse<AsyncCallbackResponse>(contentType, range_size, fill_range);
+        response->setCode(206);
+        response->addHeader(F("Content-Range"),
+                            PSTR("bytes ") + String(first) + '-' + String(last) + '/' + String(file_size));
+        if (file_path.endsWith(F(".gz")) && !path.endsWith(F(".gz")) && !is_download) {
+            response->addHeader(F("Content-Encoding"), F("gzip"));
+        }
+        if (is_download) {
+            response->addHeader(F("Content-Disposition"),
+                                PSTR("attachment; filename=\"") + path.substring(path.lastIndexOf('/') + 1) + '"');
+        }
+    }
+    else {
+        // Web server sets Content-Encoding by itself only for ".gz" files
+        response = new RangeResponse<AsyncFileResponse>(file, path, contentType, is_download);
+    }
+    add_cache_headers(response, path, etag, has_variants);
+    if (is_br) {
+        response->addHeader(F("Content-Encoding"), F("br"));
+    }
+    request->send(response);
+    return true;
+}
+
+bool
+WebServer::handle_bundled_file_read(AsyncWebServerRequest* request, String const& path, String const& content_type)
+{
+    auto asset = WebUiBundle::find(path);
+    if (asset == nullptr) {
+        return false;
+    }
+
+    auto etag = make_etag(asset->content_hash);
+    if (reply_not_modified(request, path, etag, false)) {
+        return true;
+    }
+    AsyncWebServerResponse* response = request->beginResponse_P(200, content_type, asset->data, asset->size);
+    add_cache_headers(response, path, etag, false);
+    // Bundle has only gzip variant, so it is sent to any client, like edit.htm.gz
+    response->addHeader(F("Content-Encoding"), F("gzip"));
+    request->send(response);
+    return true;
+}
+
+bool
+WebServer::reply_not_modified(AsyncWebServerRequest* request, String const& path, String const& etag, bool has_variants)
+{
+    if (request->header(FPSTR(IF_NONE_MATCH)) != etag) {
+        return false;
+    }
+
+    LOG_DEBUG(WEB, PSTR("%s is not modified\n"), path.c_str());
+    AsyncWebServerResponse* response = request->beginResponse(304);
+    add_cache_headers(response, path, etag, has_variants);
+    request->send(response);
+    return true;
 }
 
 void
-WebServer::handle_esp_sw_upload()
+WebServer::add_cache_headers(AsyncWebServerResponse* response,
+                             String const&           path,
+                             String const&           etag,
+                             bool                    has_variants)
+{
+    response->addHeader(F("ETag"), etag);
+    response->addHeader(F("Cache-Control"), FPSTR(get_cache_control(path)));
+    if (has_variants) {
+        response->addHeader(F("Vary"), F("Accept-Encoding"));
+    }
+}
+
+void
+WebServer::handle_esp_sw_upload(AsyncWebServerRequest* request,
+                                String const&          filename,
+                                size_t                 index,
+                                uint8_t*               data,
+                                size_t                 size,
+                                bool                   is_final)
 {
     // NOTE! There is no way in HTML to stop client from uploading file. So, if it starts uploading of too big file and
     // ESP, as a server, identifies it, the only thing ESP can do is to mark this uploaded file as invalid, receive it
     // completely and only then send error. But error should be sent only once, otherwise when client will finish
     // uploading it will receive all error messages, sent during upload, at one time
 
-    if (web_server_.args() < 1) {
-        esp_firmware_upload_error_ = F("ERROR: file size is not provided!");
-        return;
-    }
-
-    HTTPUpload& upload = web_server_.upload();
-    if (upload.status == UPLOAD_FILE_START) {
-        auto file_size = web_server_.arg(F("file_size")).toInt();
+    if (index == 0) {
+        if (request->args() < 1) {
+            esp_firmware_upload_error_ = F("ERROR: file size is not provided!");
+            return;
+        }
+        // Previous upload could be aborted by client
+        ota_.abort();
+
+        // Updater should not yield, when it is called from web server callbacks
+        Update.runAsync(true);
+        auto file_size = request->arg(F("file_size")).toInt();
+        // Image, compressed with gzip, is inflated by bootloader on reboot. Inflated image should fit into flash too
+        if (request->hasArg(F("image_size")) &&
+            (static_cast<size_t>(request->arg(F("image_size")).toInt()) > OtaSession::max_image_size())) {
+            esp_firmware_upload_error_ =
+                PSTR("ERROR: not enough space! Available: ") + String(OtaSession::max_image_size());
+            return;
+        }
         if (!Update.begin(file_size)) {
             Update.end();
             Update.printError(DGB_STREAM);
@@ -534,35 +1123,28 @@ WebServer::handle_esp_sw_upload()
 
         DGB_STREAM.setDebugOutput(true);
         WiFiUDP::stopAll();
-        DEBUG_PRINTLN(PSTR("Start uploading file: ") + upload.filename);
+        LOG_INFO(WEB, PSTR("Start uploading file: %s\n"), filename.c_str());
         esp_firmware_upload_error_ = "";
     }
-    else if (upload.status == UPLOAD_FILE_WRITE) {
-        if (esp_firmware_upload_error_.length() != 0) {
-            // Ignore uploading of file which is already marked as invalid. Do NOT send any errors to client here,
-            // because there is no way to stop uploading but all sent messages will come together to client when it
-            // finish uploading
-            return;
-        }
 
-        if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-            Update.end();
-            Update.printError(DGB_STREAM);
-            esp_firmware_upload_error_ = PSTR("ERROR: can not write file! Update error ") + String(Update.getError());
-            DGB_STREAM.setDebugOutput(false);
-            return;
-        }
+    if (esp_firmware_upload_error_.length() != 0) {
+        // Ignore uploading of file which is already marked as invalid. Do NOT send any errors to client here,
+        // because there is no way to stop uploading but all sent messages will come together to client when it
+        // finish uploading
+        return;
     }
-    else if (upload.status == UPLOAD_FILE_END) {
-        if (esp_firmware_upload_error_.length() != 0) {
-            // Ignore finalizing of upload of file which is already marked as invalid. Do NOT send any errors to client
-            // here, because there is no way to stop uploading but all sent messages will come together to client when
-            // it finish uploading
-            return;
-        }
 
+    if (Update.write(data, size) != size) {
+        Update.end();
+        Update.printError(DGB_STREAM);
+        esp_firmware_upload_error_ = PSTR("ERROR: can not write file! Update error ") + String(Update.getError());
+        DGB_STREAM.setDebugOutput(false);
+        return;
+    }
+
+    if (is_final) {
         if (Update.end(true)) {  // true to set the size to the current progress
-            DEBUG_PRINTLN(PSTR("Update completed. Uploaded file size: ") + String(upload.totalSize));
+            LOG_INFO(WEB, PSTR("Update completed. Uploaded file size: %u\n"), index + size);
         }
         else {
             Update.end();
@@ -572,33 +1154,255 @@ WebServer::handle_esp_sw_upload()
         }
         DGB_STREAM.setDebugOutput(false);
     }
-    else {
-        Update.end();
-        Update.printError(DGB_STREAM);
-        esp_firmware_upload_error_ = F("ERROR: uploading of file was aborted");
-        DGB_STREAM.setDebugOutput(false);
+}
+
+void
+WebServer::handle_ota_begin(AsyncWebServerRequest* request)
+{
+    if (!request->hasArg(F("size")) || !is_number(request->arg(F("size")))) {
+        return reply_bad_request(request, F("SIZE ARG MISSING"));
+    }
+    // Size of image after inflating is optional, it is given only for compressed images
+    size_t image_size{0};
+    if (request->hasArg(F("image_size")) && is_number(request->arg(F("image_size")))) {
+        image_size = request->arg(F("image_size")).toInt();
+    }
+    if (!ota_.begin(request->arg(F("size")).toInt(), image_size, request->arg(F("md5")), request->arg(F("sha256")))) {
+        return reply_server_error(request, FPSTR(ota_.error()));
+    }
+    reply_ota_status(request);
+}
+
+void
+WebServer::handle_ota_chunk(AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index)
+{
+    if (request->_tempObject != nullptr) {
+        // Chunk is already rejected, ignore the rest of it
         return;
     }
-    yield();
+    if (!request->hasArg(F("offset")) || !is_number(request->arg(F("offset")))) {
+        return set_upload_error(request, PSTR("OFFSET ARG MISSING"));
+    }
+    if (!ota_.write(request->arg(F("offset")).toInt() + index, data, size)) {
+        set_upload_error(request, ota_.error());
+    }
 }
 
 void
-WebServer::handle_reset_wifi_settings()
+WebServer::handle_ota_chunk_end(AsyncWebServerRequest* request)
 {
-    reply_ok();
-    delay(500);  // Add delay to make sure response is sent to client
+    if (request->_tempObject != nullptr) {
+        if (ota_.state() != OtaSession::State::RUNNING) {
+            return reply_server_error(request, static_cast<char const*>(request->_tempObject));
+        }
+        // Update is still alive, client should continue from committed offset
+        return reply_ota_status(request, 409);
+    }
 
-    DEBUG_PRINTLN(F("handle_reset_wifi_settings"));
-    if (handlers_[static_cast<size_t>(Event::RESET_WIFI_SETTINGS)] != nullptr) {
-        handlers_[static_cast<size_t>(Event::RESET_WIFI_SETTINGS)]("");
+    reply_ota_status(request);
+    if (ota_.state() == OtaSession::State::COMPLETED) {
+        LOG_INFO(WEB, PSTR("Rebooting...\n"));
+        handle_reboot_esp();
     }
 }
 
 void
-WebServer::handle_reboot_esp()
+WebServer::reply_ota_status(AsyncWebServerRequest* request, int code)
+{
+    String status{F("{\"state\":\"")};
+    status += FPSTR(pgm_read_ptr(&ota_state_names[static_cast<uint8_t>(ota_.state())]));
+    status += F("\",\"size\":");
+    status += ota_.size();
+    status += F(",\"offset\":");
+    status += ota_.offset();
+    status += F(",\"error\":\"");
+    if (ota_.error() != nullptr) {
+        status += FPSTR(ota_.error());
+    }
+    status += F("\"}");
+    request->send(code, FPSTR(TEXT_JSON), status);
+}
+
+void
+WebServer::handle_fs_update_manifest(AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index)
+{
+    if (index == 0) {
+        fs_update_.begin();
+    }
+    if ((request->_tempObject == nullptr) && !fs_update_.add_manifest(data, size)) {
+        set_upload_error(request, fs_update_.error());
+    }
+}
+
+void
+WebServer::handle_fs_update_begin(AsyncWebServerRequest* request)
+{
+    if (request->_tempObject != nullptr) {
+        return reply_bad_request(request, static_cast<char const*>(request->_tempObject));
+    }
+    if (request->contentLength() == 0) {
+        return reply_bad_request(request, F("MANIFEST MISSING"));
+    }
+    if (!fs_update_.end_manifest()) {
+        return reply_bad_request(request, FPSTR(fs_update_.error()));
+    }
+
+    String reply{F("{\"files\":[")};
+    auto   files = fs_update_.missing_files();
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (i != 0) {
+            reply += ',';
+        }
+        reply += '"';
+        reply += files[i];
+        reply += '"';
+    }
+    reply += F("]}");
+    reply_ok_json_with_msg(request, reply);
+}
+
+void
+WebServer::handle_fs_update_file(AsyncWebServerRequest* request,
+                                 uint8_t*               data,
+                                 size_t                 size,
+                                 size_t                 index,
+                                 size_t                 total)
+{
+    if (request->_tempObject != nullptr) {
+        // File is already rejected, ignore the rest of it
+        return;
+    }
+    if (!request->hasArg(F("path"))) {
+        return set_upload_error(request, PSTR("PATH ARG MISSING"));
+    }
+    if (!fs_update_.write_file(request->arg(F("path")), data, size, index, total)) {
+        set_upload_error(request, fs_update_.error());
+    }
+}
+
+void
+WebServer::handle_fs_update_file_end(AsyncWebServerRequest* request)
+{
+    // Body handler is not called for empty file
+    if ((request->contentLength() == 0) && (request->_tempObject == nullptr)) {
+        handle_fs_update_file(request, nullptr, 0, 0, 0);
+    }
+    if (request->_tempObject != nullptr) {
+        return reply_server_error(request, static_cast<char const*>(request->_tempObject));
+    }
+    reply_ok(request);
+}
+
+void
+WebServer::handle_fs_update_commit(AsyncWebServerRequest* request)
 {
-    DEBUG_PRINTLN(F("handle_reboot_esp"));
-    if (handlers_[static_cast<size_t>(Event::REBOOT_ESP)] != nullptr) {
-        handlers_[static_cast<size_t>(Event::REBOOT_ESP)]("");
+    auto num_of_files = fs_update_.commit();
+    if (num_of_files < 0) {
+        return reply_server_error(request, FPSTR(fs_update_.error()));
+    }
+    reply_ok_json_with_msg(request, String{F("{\"updated\":")} + num_of_files + '}');
+}
+
+void
+WebServer::set_lamp_state(ArduinoSettings const& settings, uint8_t changed_fields)
+{
+    lamp_state_ = settings;
+    for (uint8_t i = 0; i < static_cast<uint8_t>(ArduinoSettings::Field::NUM_OF_FIELDS); ++i) {
+        if ((changed_fields & ArduinoSettings::field_mask(static_cast<ArduinoSettings::Field>(i))) != 0) {
+            lamp_state_update_times_[i] = millis();
+        }
+    }
+}
+
+void
+WebServer::handle_api_state(AsyncWebServerRequest* request)
+{
+    using Field = ArduinoSettings::Field;
+
+    // Reply either all fields or one of them
+    uint8_t fields_mask{ArduinoSettings::all_fields_mask};
+    String  field_name{request->url().substring(strlen_P(PSTR("/api/state")))};
+    if (!field_name.isEmpty() && (field_name != "/")) {
+        Field field;
+        if (!ArduinoSettings::find_field(field_name.substring(1), field)) {
+            return reply_not_found(request, FPSTR(FILE_NOT_FOUND));
+        }
+        fields_mask = ArduinoSettings::field_mask(field);
+    }
+    auto is_single_field = (fields_mask != ArduinoSettings::all_fields_mask);
+
+    // Time of update is part of reply, so reply is stable while cache is not changed and ETag can be used
+    String        reply{is_single_field ? "" : "{"};
+    unsigned long oldest_update_time{millis()};
+    bool          has_valid_fields{false};
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Field::NUM_OF_FIELDS); ++i) {
+        auto field = static_cast<Field>(i);
+        if ((fields_mask & ArduinoSettings::field_mask(field)) == 0) {
+            continue;
+        }
+        if (!is_single_field) {
+            if (i != 0) {
+                reply += ',';
+            }
+            reply += '"';
+            reply += FPSTR(ArduinoSettings::field_name(field));
+            reply += F("\":");
+        }
+        reply += F("{\"value\":");
+        reply += lamp_state_.field_to_json(field);
+        reply += F(",\"updated\":");
+        if (lamp_state_.is_valid(field)) {
+            reply += lamp_state_update_times_[i] / 1000;
+            oldest_update_time = std::min(oldest_update_time, lamp_state_update_times_[i]);
+            has_valid_fields   = true;
+        }
+        else {
+            reply += F("null");
+        }
+        reply += '}';
+    }
+    if (!is_single_field) {
+        reply += '}';
     }
+
+    char etag[11];
+    snprintf_P(etag,
+               sizeof(etag),
+               PSTR("\"%08x\""),
+               FsIndex::hash_content(
+                   FsIndex::empty_content_hash, reinterpret_cast<uint8_t const*>(reply.c_str()), reply.length()));
+    auto is_not_modified = (request->header(FPSTR(IF_NONE_MATCH)) == etag);
+
+    AsyncWebServerResponse* response =
+        is_not_modified ? request->beginResponse(304) : request->beginResponse(200, FPSTR(TEXT_JSON), reply);
+    response->addHeader(F("ETag"), etag);
+    response->addHeader(F("Cache-Control"), FPSTR(no_cache));
+    if (has_valid_fields) {
+        response->addHeader(F("Age"), String((millis() - oldest_update_time) / 1000));
+    }
+    request->send(response);
+}
+
+void
+WebServer::handle_reset_wifi_settings(AsyncWebServerRequest* request)
+{
+    reply_ok(request);
+
+    LOG_INFO(WEB, PSTR("handle_reset_wifi_settings\n"));
+    // Reset is handled in loop(), after response is sent to client
+    schedule_event(Event::RESET_WIFI_SETTINGS);
+}
+
+void
+WebServer::handle_reboot_esp()
+{
+    LOG_INFO(WEB, PSTR("handle_reboot_esp\n"));
+    schedule_event(Event::REBOOT_ESP);
+}
+
+void
+WebServer::schedule_event(Event event)
+{
+    pending_events_ |= 1 << static_cast<uint8_t>(event);
+    pending_events_time_ = millis();
 }
@@ -3,12 +3,24 @@
 
 #include <array>
 #include <functional>
+#include <memory>
+#include <vector>
 
-#include <ESP8266WebServer.h>
+#include <ESPAsyncWebServer.h>
 #include <FS.h>
 
+#include "ArduinoSettings.h"
+#include "FsBatch.h"
+#include "FsUpdate.h"
+#include "OtaSession.h"
+#include "UploadWriter.h"
+
 // TODO: This web server handles filesystem operations (list, create, delete files, etc.) inside. Better to move it
 // out to new entity. But for simple UI it is fine.
+// Web server is asynchronous: requests of several clients are handled at once, in background, outside of loop(), and
+// responses are sent piece by piece, when there is free space in TCP window. So serving of large file doesn't block
+// WebSocket, serial and FTP traffic. Keep-alive is not supported by ESPAsyncWebServer: connection is closed after every
+// response, so browser loads resources of page over several parallel connections.
 class WebServer
 {
 public:
@@ -27,29 +39,91 @@ public:
 
     void set_handler(Event event, EventHandler handler);
 
+    // Update cached state of lamp, which is served by "GET /api/state". Requests are replied from cache, so polling of
+    // state doesn't cause any traffic to Arduino
+    void set_lamp_state(ArduinoSettings const& settings, uint8_t changed_fields);
+
 private:
-    void reply_ok();
-    void reply_ok_with_msg(String const& msg);
-    void reply_ok_json_with_msg(String const& msg);
-    void reply_not_found(String const& msg);
-    void reply_bad_request(String const& msg);
-    void reply_server_error(String const& msg);
-
-    void handle_file_list();
-    void handle_file_create();
-    void delete_recursive(String const& path);
-    void handle_file_delete();
-    void handle_file_upload();
-    bool handle_file_read(String path);
-    void handle_esp_sw_upload();
-    void handle_reset_wifi_settings();
+    struct Upload
+    {
+        AsyncWebServerRequest*        request;
+        std::unique_ptr<UploadWriter> writer;
+    };
+    struct PendingBatch
+    {
+        AsyncWebServerRequest*   request;  // nullptr if client disconnected. Batch is run anyway, but not replied
+        std::shared_ptr<FsBatch> batch;
+    };
+
+    void reply_ok(AsyncWebServerRequest* request);
+    void reply_ok_with_msg(AsyncWebServerRequest* request, String const& msg);
+    void reply_ok_json_with_msg(AsyncWebServerRequest* request, String const& msg);
+    void reply_not_found(AsyncWebServerRequest* request, String const& msg);
+    void reply_bad_request(AsyncWebServerRequest* request, String const& msg);
+    void reply_server_error(AsyncWebServerRequest* request, String const& msg);
+
+    void handle_file_list(AsyncWebServerRequest* request);
+    void handle_file_create(AsyncWebServerRequest* request);
+    void handle_file_delete(AsyncWebServerRequest* request);
+    void handle_batch_body(AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index, size_t total);
+    void handle_batch(AsyncWebServerRequest* request);
+    // Run one operation of the oldest pending batch and reply, when all its operations are done
+    void run_batches();
+    void handle_file_upload(AsyncWebServerRequest* request,
+                            String const&          filename,
+                            size_t                 index,
+                            uint8_t*               data,
+                            size_t                 size,
+                            bool                   is_final);
+    UploadWriter* find_upload(AsyncWebServerRequest* request);
+    void          remove_upload(AsyncWebServerRequest* request);
+    bool          handle_file_read(AsyncWebServerRequest* request, String path);
+    // Serve page from web UI bundle, embedded into firmware
+    bool handle_bundled_file_read(AsyncWebServerRequest* request, String const& path, String const& content_type);
+    // Reply "304 Not Modified" if client already has version of file with this ETag. Returns whether reply is sent
+    bool reply_not_modified(AsyncWebServerRequest* request, String const& path, String const& etag, bool has_variants);
+    void add_cache_headers(AsyncWebServerResponse* response,
+                           String const&           path,
+                           String const&           etag,
+                           bool                    has_variants);
+    void handle_esp_sw_upload(AsyncWebServerRequest* request,
+                              String const&          filename,
+                              size_t                 index,
+                              uint8_t*               data,
+                              size_t                 size,
+                              bool                   is_final);
+    // Resumable update of ESP firmware. Image is uploaded in chunks, see OtaSession
+    void handle_ota_begin(AsyncWebServerRequest* request);
+    void handle_ota_chunk(AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index);
+    void handle_ota_chunk_end(AsyncWebServerRequest* request);
+    void reply_ota_status(AsyncWebServerRequest* request, int code = 200);
+    // Update of set of files on SPIFFS as a whole, see FsUpdate
+    void handle_fs_update_manifest(AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index);
+    void handle_fs_update_begin(AsyncWebServerRequest* request);
+    void handle_fs_update_file(AsyncWebServerRequest* request, uint8_t* data, size_t size, size_t index, size_t total);
+    void handle_fs_update_file_end(AsyncWebServerRequest* request);
+    void handle_fs_update_commit(AsyncWebServerRequest* request);
+    // Read-only REST API for cached state of lamp
+    void handle_api_state(AsyncWebServerRequest* request);
+    void handle_reset_wifi_settings(AsyncWebServerRequest* request);
     void handle_reboot_esp();
+    // Handlers of events can not be called from request handlers, which are called by web server in background
+    void schedule_event(Event event);
 
     const uint16_t                                                       port_{80};
-    ESP8266WebServer                                                     web_server_;
-    File                                                                 upload_file_;
+    AsyncWebServer                                                       web_server_;
     std::array<EventHandler, static_cast<uint8_t>(Event::NUM_OF_EVENTS)> handlers_;
     String                                                               esp_firmware_upload_error_;
+    OtaSession                                                           ota_;
+    FsUpdate                                                             fs_update_;
+    ArduinoSettings                                                      lamp_state_;
+
+    // Uptime, when field of lamp state was received from Arduino, ms
+    std::array<unsigned long, static_cast<uint8_t>(ArduinoSettings::Field::NUM_OF_FIELDS)> lamp_state_update_times_{};
+    std::vector<Upload>                                                  uploads_;  // Files, being uploaded now
+    std::vector<PendingBatch>                                            batches_;  // Waiting to be run in loop()
+    uint8_t                                                              pending_events_{0};  // Bit per event
+    unsigned long                                                        pending_events_time_{0};
 };
 
 #endif  // WEBSERVER_H_
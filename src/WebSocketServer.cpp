@@ -1,19 +1,93 @@
 #include "WebSocketServer.h"
 
+#include <algorithm>
+
+#include "SettingsCodec.h"
 #include "logger.h"
 
+namespace
+{
+// Rate limits of command classes: burst size and period of getting one more token
+struct RateLimit
+{
+    uint8_t       burst;
+    unsigned long refill_period;  // ms
+};
+constexpr RateLimit rate_limits[] PROGMEM = {
+    {4, 500},    // LOGS
+    {5, 200},    // RAW_ARDUINO_COMMAND
+    {2, 2000},   // GET_SETTINGS: each request costs 4 round trips to Arduino
+    {5, 250},    // SET_SETTINGS
+    {1, 10000},  // FLASH_OR_REBOOT
+};
+static_assert(sizeof(rate_limits) / sizeof(rate_limits[0]) ==
+                  static_cast<size_t>(WebSocketServer::CommandClass::NUM_OF_COMMAND_CLASSES),
+              "Rate limit should be defined for every command class");
+
+WebSocketServer::CommandClass
+get_command_class(WebSocketServer::Event event)
+{
+    using Event        = WebSocketServer::Event;
+    using CommandClass = WebSocketServer::CommandClass;
+    // No default case, so compiler warns about new event, which is not classified
+    switch (event) {
+    case Event::CONNECTED:
+    case Event::DISCONNECTED:
+    case Event::STOP_READING_LOGS:
+    case Event::NUM_OF_EVENTS:
+        return CommandClass::UNLIMITED;
+    case Event::START_READING_LOGS:
+    case Event::GET_LOG_LEVELS:
+    case Event::SET_LOG_LEVELS:
+    case Event::SEARCH_LOGS:
+        return CommandClass::LOGS;
+    case Event::ARDUINO_COMMAND:
+        return CommandClass::RAW_ARDUINO_COMMAND;
+    case Event::GET_ARDUINO_SETTINGS:
+        return CommandClass::GET_SETTINGS;
+    case Event::ARDUINO_SET_DATETIME:
+    case Event::ENABLE_ARDUINO_ALARM:
+    case Event::SET_ARDUINO_ALARM_TIME:
+    case Event::SET_ARDUINO_SUNRISE_DURATION:
+    case Event::SET_ARDUINO_BRIGHTNESS:
+        return CommandClass::SET_SETTINGS;
+    case Event::FLASH_ARDUINO:
+    case Event::REBOOT_ARDUINO:
+        return CommandClass::FLASH_OR_REBOOT;
+    }
+    return CommandClass::UNLIMITED;
+}
+
+constexpr char          binary_encoding_url[] PROGMEM = "/binary";
+constexpr unsigned long default_coalescing_window{20};  // ms
+constexpr size_t        record_header_size{2};
+constexpr uint32_t      min_free_heap_for_new_client{8 * 1024};
+constexpr uint16_t      close_code_try_again_later{1013};
+}  // namespace
+
+constexpr uint8_t WebSocketServer::batch_marker;
+constexpr size_t  WebSocketServer::default_max_frame_size;
+
 WebSocketServer::WebSocketServer()
   : web_socket_{port_}
   , handlers_{
         nullptr,
     }
+  , coalescing_window_{default_coalescing_window}
+  , max_frame_size_{default_max_frame_size}
 {
+    encodings_.fill(Encoding::TEXT);
+    is_connected_.fill(false);
 }
 
 void
 WebSocketServer::init()
 {
     web_socket_.begin();
+    LOG_INFO(WS,
+             PSTR("WebSocket server capacity: %u clients, %u bytes per client\n"),
+             max_clients,
+             estimated_client_memory);
     web_socket_.onEvent([this](uint8_t client_num, WStype_t event_type, uint8_t* payload, size_t lenght) {
         on_event(client_num, event_type, payload, lenght);
     });
@@ -23,6 +97,7 @@ void
 WebSocketServer::loop()
 {
     web_socket_.loop();
+    flush_expired();
 }
 
 void
@@ -32,12 +107,143 @@ WebSocketServer::set_handler(Event event, EventHandler handler)
 }
 
 void
-WebSocketServer::send(uint8_t client_id, String const& message)
+WebSocketServer::send(uint8_t client_id, String const& message, RequestId request_id, Priority priority)
 {
     // Use sendBIN() instead of sendTXT(). Binary-based communication let transfering special characters.
     // Ex. Arduino when rebooted can send via Serial port some special (non printable) characters. It ruins text-based
     // web-socket but binary-based web-socket handles it well.
-    web_socket_.sendBIN(client_id, (const uint8_t*)message.c_str(), message.length());
+    if (encoding(client_id) == Encoding::BINARY) {
+        auto frame = SettingsCodec::encode_status(message, request_id);
+        send_binary(client_id, frame.data(), frame.size(), priority);
+        return;
+    }
+
+    if (request_id == NO_REQUEST_ID) {
+        send_binary(client_id, (const uint8_t*)message.c_str(), message.length(), priority);
+        return;
+    }
+
+    String envelope{'#'};
+    envelope.reserve(message.length() + 12);
+    envelope += request_id;
+    envelope += ' ';
+    envelope += message;
+    send_binary(client_id, (const uint8_t*)envelope.c_str(), envelope.length(), priority);
+}
+
+void
+WebSocketServer::send_binary(uint8_t client_id, uint8_t const* data, size_t length, Priority priority)
+{
+    if ((client_id >= outbound_buffers_.size()) || !is_connected_[client_id]) {
+        return;
+    }
+
+    auto& buffer = outbound_buffers_[client_id];
+    // Message, which doesn't fit in frame, is sent as is. All previous messages should be sent before it
+    if ((coalescing_window_ == 0) || (priority == Priority::URGENT) ||
+        (1 + record_header_size + length > max_frame_size_)) {
+        flush(client_id);
+        send_frame(client_id, data, length);
+        return;
+    }
+
+    if (buffer.data.size() + record_header_size + length > max_frame_size_) {
+        flush(client_id);
+    }
+    if (buffer.num_of_messages == 0) {
+        buffer.data.reserve(max_frame_size_);
+        buffer.data.push_back(batch_marker);
+        buffer.first_message_time = millis();
+    }
+    buffer.data.push_back(static_cast<uint8_t>(length & 0xFF));
+    buffer.data.push_back(static_cast<uint8_t>(length >> 8));
+    buffer.data.insert(buffer.data.end(), data, data + length);
+    ++buffer.num_of_messages;
+
+    auto& statistics             = statistics_[client_id];
+    statistics.queued_bytes      = buffer.data.size();
+    statistics.peak_queued_bytes = std::max(statistics.peak_queued_bytes, statistics.queued_bytes);
+    statistics.buffer_capacity   = buffer.data.capacity();
+}
+
+void
+WebSocketServer::send_frame(uint8_t client_id, uint8_t const* data, size_t length)
+{
+    if (web_socket_.sendBIN(client_id, data, length)) {
+        statistics_[client_id].sent_bytes += length;
+    }
+}
+
+void
+WebSocketServer::set_coalescing(unsigned long window_ms, size_t max_frame_size)
+{
+    for (uint8_t client_id = 0; client_id < outbound_buffers_.size(); ++client_id) {
+        flush(client_id);
+    }
+    coalescing_window_ = window_ms;
+    max_frame_size_    = max_frame_size;
+}
+
+void
+WebSocketServer::flush(uint8_t client_id)
+{
+    auto& buffer = outbound_buffers_[client_id];
+    if (buffer.num_of_messages == 0) {
+        return;
+    }
+
+    constexpr size_t first_message_offset{1 + record_header_size};
+    if ((buffer.num_of_messages == 1) && (buffer.data[first_message_offset] != batch_marker)) {
+        // There is no need in batch format for single message
+        send_frame(client_id, buffer.data.data() + first_message_offset, buffer.data.size() - first_message_offset);
+    }
+    else {
+        send_frame(client_id, buffer.data.data(), buffer.data.size());
+    }
+
+    // Keep reserved memory for next messages
+    buffer.data.clear();
+    buffer.num_of_messages               = 0;
+    statistics_[client_id].queued_bytes = 0;
+}
+
+void
+WebSocketServer::flush_expired()
+{
+    auto now = millis();
+    for (uint8_t client_id = 0; client_id < outbound_buffers_.size(); ++client_id) {
+        auto const& buffer = outbound_buffers_[client_id];
+        if ((buffer.num_of_messages != 0) && (now - buffer.first_message_time >= coalescing_window_)) {
+            flush(client_id);
+        }
+    }
+}
+
+WebSocketServer::Encoding
+WebSocketServer::encoding(uint8_t client_id) const
+{
+    return (client_id < encodings_.size()) ? encodings_[client_id] : Encoding::TEXT;
+}
+
+uint8_t
+WebSocketServer::num_of_clients() const
+{
+    return std::count(is_connected_.begin(), is_connected_.end(), true);
+}
+
+WebSocketServer::ClientStatistics
+WebSocketServer::statistics(uint8_t client_id) const
+{
+    return (client_id < statistics_.size()) ? statistics_[client_id] : ClientStatistics{};
+}
+
+size_t
+WebSocketServer::client_memory_usage(uint8_t client_id) const
+{
+    if ((client_id >= is_connected_.size()) || !is_connected_[client_id]) {
+        return 0;
+    }
+    return sizeof(WSclient_t) + connection_overhead + statistics_[client_id].buffer_capacity;
 }
 
 void
@@ -47,76 +253,168 @@ WebSocketServer::on_event(uint8_t client_id, WStype_t event_type, uint8_t* paylo
     case WStype_CONNECTED: {
         // New websocket connection is established
         IPAddress ip = web_socket_.remoteIP(client_id);
-        DEBUG_PRINTF(PSTR("[%u] Connected from %d.%d.%d.%d url: %s\n"), client_id, ip[0], ip[1], ip[2], ip[3], payload);
+        LOG_INFO(WS,
+                 PSTR("[%u] Connected from %d.%d.%d.%d url: %s, free heap %u\n"),
+                 client_id,
+                 ip[0],
+                 ip[1],
+                 ip[2],
+                 ip[3],
+                 reinterpret_cast<char const*>(payload),
+                 ESP.getFreeHeap());
+        if (client_id >= is_connected_.size()) {
+            break;
+        }
+
+        // Refuse clients beyond capacity or when there is not enough memory
+        if ((num_of_clients() >= max_clients) || (ESP.getFreeHeap() < min_free_heap_for_new_client)) {
+            LOG_WARNING(WS,
+                        PSTR("[%u] Refused: %u clients connected, free heap %u\n"),
+                        client_id,
+                        num_of_clients(),
+                        ESP.getFreeHeap());
+            web_socket_.disconnect(client_id, close_code_try_again_later);
+            break;
+        }
+
+        is_connected_[client_id] = true;
+        statistics_[client_id]   = ClientStatistics{};
+        for (size_t i = 0; i < rate_limiters_[client_id].size(); ++i) {
+            RateLimit rate_limit;
+            memcpy_P(&rate_limit, &rate_limits[i], sizeof(rate_limit));
+            rate_limiters_[client_id][i] = TokenBucket(rate_limit.burst, rate_limit.refill_period);
+            rate_limiters_[client_id][i].reset(millis());
+        }
+        encodings_[client_id] =
+            (strcmp_P((char const*)payload, binary_encoding_url) == 0) ? Encoding::BINARY : Encoding::TEXT;
         if (handlers_[static_cast<size_t>(Event::CONNECTED)] != nullptr) {
-            handlers_[static_cast<size_t>(Event::CONNECTED)](client_id, "");
+            handlers_[static_cast<size_t>(Event::CONNECTED)](client_id, NO_REQUEST_ID, "");
         }
         break;
     }
 
     case WStype_DISCONNECTED:
         // Websocket is disconnected
-        DEBUG_PRINTF(PSTR("[%u] Disconnected!\n"), client_id);
+        LOG_INFO(WS, PSTR("[%u] Disconnected!\n"), client_id);
+        if ((client_id >= is_connected_.size()) || !is_connected_[client_id]) {
+            // Client was refused on connection
+            break;
+        }
+
+        LOG_DEBUG(WS,
+                  PSTR("[%u] Sent %u bytes, peak queued %u bytes, buffer %u bytes\n"),
+                  client_id,
+                  statistics_[client_id].sent_bytes,
+                  statistics_[client_id].peak_queued_bytes,
+                  statistics_[client_id].buffer_capacity);
+        is_connected_[client_id] = false;
+        // Drop messages, which were not sent yet, and release memory
+        outbound_buffers_[client_id].data            = std::vector<uint8_t>();
+        outbound_buffers_[client_id].num_of_messages = 0;
+        statistics_[client_id].queued_bytes          = 0;
+        statistics_[client_id].buffer_capacity       = 0;
         if (handlers_[static_cast<size_t>(Event::DISCONNECTED)] != nullptr) {
-            handlers_[static_cast<size_t>(Event::DISCONNECTED)](client_id, "");
+            handlers_[static_cast<size_t>(Event::DISCONNECTED)](client_id, NO_REQUEST_ID, "");
         }
         break;
 
-    case WStype_TEXT:
+    case WStype_TEXT: {
         // New text data is received
-        String command((char const*)payload);
-        process_command(client_id, command);
+        if ((client_id >= is_connected_.size()) || !is_connected_[client_id]) {
+            // Client was refused on connection. Its commands should not consume resources
+            break;
+        }
+
+        String    command((char const*)payload);
+        RequestId request_id{NO_REQUEST_ID};
+        if (command.startsWith("#")) {
+            // Command in correlation envelope: "#<request_id> <command>"
+            auto separator_position = command.indexOf(' ');
+            request_id              = command.substring(1, separator_position).toInt();
+            if ((separator_position == -1) || (request_id == NO_REQUEST_ID)) {
+                LOG_WARNING(WS, PSTR("ERROR: invalid request envelope \"%s\"\n"), command.c_str());
+                return;
+            }
+            command.remove(0, separator_position + 1);
+        }
+        process_command(client_id, request_id, command);
         break;
     }
+
+    case WStype_BIN:
+        // New binary command is received
+        if ((client_id >= is_connected_.size()) || !is_connected_[client_id]) {
+            // Client was refused on connection
+            break;
+        }
+
+        process_binary_command(client_id, payload, lenght);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void
+WebSocketServer::reply_error(uint8_t client_id, RequestId request_id, String const& message)
+{
+    LOG_WARNING(WS, PSTR("%s\n"), message.c_str());
+    // Client, which uses correlation envelope, waits for reply to each request. So let it know about the error
+    if (request_id != NO_REQUEST_ID) {
+        send(client_id, message, request_id);
+    }
 }
 
 void
-WebSocketServer::trigger_event(uint8_t client_id, String const& input_data, String const& command_name, Event event)
+WebSocketServer::trigger_event(uint8_t       client_id,
+                               RequestId     request_id,
+                               String const& input_data,
+                               String const& command_name,
+                               Event         event)
 {
     if (input_data.length() <= (command_name.length() + 1)) {
-        DEBUG_PRINTLN(PSTR("ERROR: command \"") + command_name + F("\" doesn't have parameters"));
+        reply_error(client_id, request_id, PSTR("ERROR: command \"") + command_name + F("\" doesn't have parameters"));
         return;
     }
 
-    DEBUG_PRINTLN(PSTR("Received command \"") + input_data + "\"");
+    LOG_DEBUG(WS, PSTR("Received command \"%s\"\n"), input_data.c_str());
     auto parameters = input_data.substring(command_name.length() + 1);
-    if (handlers_[static_cast<size_t>(event)] != nullptr) {
-        handlers_[static_cast<size_t>(event)](client_id, parameters);
-    }
+    dispatch(client_id, request_id, event, parameters);
 }
 
 void
-WebSocketServer::process_command(uint8_t client_id, String const& command)
+WebSocketServer::process_command(uint8_t client_id, RequestId request_id, String const& command)
 {
     if (command == F("start_reading_logs")) {
-        DEBUG_PRINTLN(PSTR("Received command \"") + command + "\"");
-        if (handlers_[static_cast<size_t>(Event::START_READING_LOGS)] != nullptr) {
-            handlers_[static_cast<size_t>(Event::START_READING_LOGS)](client_id, "");
-        }
+        LOG_DEBUG(WS, PSTR("Received command \"%s\"\n"), command.c_str());
+        dispatch(client_id, request_id, Event::START_READING_LOGS, "");
         return;
     }
     else if (command == F("stop_reading_logs")) {
-        DEBUG_PRINTLN(PSTR("Received command \"") + command + "\"");
-        if (handlers_[static_cast<size_t>(Event::STOP_READING_LOGS)] != nullptr) {
-            handlers_[static_cast<size_t>(Event::STOP_READING_LOGS)](client_id, "");
-        }
+        LOG_DEBUG(WS, PSTR("Received command \"%s\"\n"), command.c_str());
+        dispatch(client_id, request_id, Event::STOP_READING_LOGS, "");
+        return;
+    }
+    else if (command == F("get_log_levels")) {
+        LOG_DEBUG(WS, PSTR("Received command \"%s\"\n"), command.c_str());
+        dispatch(client_id, request_id, Event::GET_LOG_LEVELS, "");
         return;
     }
     else if (command == F("reboot_arduino")) {
-        DEBUG_PRINTLN(PSTR("Received command \"") + command + "\"");
-        if (handlers_[static_cast<size_t>(Event::REBOOT_ARDUINO)] != nullptr) {
-            handlers_[static_cast<size_t>(Event::REBOOT_ARDUINO)](client_id, "");
-        }
+        LOG_DEBUG(WS, PSTR("Received command \"%s\"\n"), command.c_str());
+        dispatch(client_id, request_id, Event::REBOOT_ARDUINO, "");
         return;
     }
     else if (command == F("get_arduino_settings")) {
-        DEBUG_PRINTLN(PSTR("Received command \"") + command + "\"");
-        if (handlers_[static_cast<size_t>(Event::GET_ARDUINO_SETTINGS)] != nullptr) {
-            handlers_[static_cast<size_t>(Event::GET_ARDUINO_SETTINGS)](client_id, "");
-        }
+        LOG_DEBUG(WS, PSTR("Received command \"%s\"\n"), command.c_str());
+        dispatch(client_id, request_id, Event::GET_ARDUINO_SETTINGS, "");
         return;
     }
 
+    String start_reading_logs_str{F("start_reading_logs")};
+    String search_logs_str{F("search_logs")};
+    String set_log_levels_str{F("set_log_levels")};
     String arduino_command_str{F("arduino_command")};
     String upload_arduino_firmware_str{F("upload_arduino_firmware")};
     String set_arduino_datetime_str{F("set_arduino_datetime")};
@@ -124,35 +422,49 @@ WebSocketServer::process_command(uint8_t client_id, String const& command)
     String set_arduino_alarm_time_str{F("set_arduino_alarm_time")};
     String set_arduino_sunrise_duration_str{F("set_arduino_sunrise_duration")};
     String set_arduino_brightness_str{F("set_arduino_brightness")};
-    if (command.startsWith(arduino_command_str)) {
-        trigger_event(client_id, command, arduino_command_str, Event::ARDUINO_COMMAND);
+    // Log filter is optional, so plain "start_reading_logs" is handled above
+    if (command.startsWith(start_reading_logs_str)) {
+        trigger_event(client_id, request_id, command, start_reading_logs_str, Event::START_READING_LOGS);
+        return;
+    }
+    else if (command.startsWith(search_logs_str)) {
+        trigger_event(client_id, request_id, command, search_logs_str, Event::SEARCH_LOGS);
+        return;
+    }
+    else if (command.startsWith(set_log_levels_str)) {
+        trigger_event(client_id, request_id, command, set_log_levels_str, Event::SET_LOG_LEVELS);
+        return;
+    }
+    else if (command.startsWith(arduino_command_str)) {
+        trigger_event(client_id, request_id, command, arduino_command_str, Event::ARDUINO_COMMAND);
         return;
     }
     else if (command.startsWith(set_arduino_datetime_str)) {
-        trigger_event(client_id, command, set_arduino_datetime_str, Event::ARDUINO_SET_DATETIME);
+        trigger_event(client_id, request_id, command, set_arduino_datetime_str, Event::ARDUINO_SET_DATETIME);
         return;
     }
     else if (command.startsWith(enable_arduino_alarm_str)) {
-        trigger_event(client_id, command, enable_arduino_alarm_str, Event::ENABLE_ARDUINO_ALARM);
+        trigger_event(client_id, request_id, command, enable_arduino_alarm_str, Event::ENABLE_ARDUINO_ALARM);
         return;
     }
     else if (command.startsWith(set_arduino_alarm_time_str)) {
-        trigger_event(client_id, command, set_arduino_alarm_time_str, Event::SET_ARDUINO_ALARM_TIME);
+        trigger_event(client_id, request_id, command, set_arduino_alarm_time_str, Event::SET_ARDUINO_ALARM_TIME);
         return;
     }
     else if (command.startsWith(set_arduino_sunrise_duration_str)) {
-        trigger_event(client_id, command, set_arduino_sunrise_duration_str, Event::SET_ARDUINO_SUNRISE_DURATION);
+        trigger_event(
+            client_id, request_id, command, set_arduino_sunrise_duration_str, Event::SET_ARDUINO_SUNRISE_DURATION);
         return;
     }
     else if (command.startsWith(set_arduino_brightness_str)) {
-        trigger_event(client_id, command, set_arduino_brightness_str, Event::SET_ARDUINO_BRIGHTNESS);
+        trigger_event(client_id, request_id, command, set_arduino_brightness_str, Event::SET_ARDUINO_BRIGHTNESS);
         return;
     }
     else if (command.startsWith(upload_arduino_firmware_str)) {
         if (command.length() <= (upload_arduino_firmware_str.length() + 1)) {
             String message{F("ERROR: command \"upload_arduino_firmware\" doesn't have parameters")};
-            DEBUG_PRINTLN(message);
-            send(client_id, message);
+            LOG_WARNING(WS, PSTR("%s\n"), message.c_str());
+            send(client_id, message, request_id);
             return;
         }
 
@@ -160,18 +472,76 @@ WebSocketServer::process_command(uint8_t client_id, String const& command)
         auto second_quote_position = command.indexOf('"', first_quote_position + 1);
         if (second_quote_position == -1) {
             String message{F("ERROR: command \"upload_arduino_firmware\" should have \"path\" parameter in quotes")};
-            DEBUG_PRINTLN(message);
-            send(client_id, message);
+            LOG_WARNING(WS, PSTR("%s\n"), message.c_str());
+            send(client_id, message, request_id);
             return;
         }
 
-        DEBUG_PRINTLN(PSTR("Received command \"") + command + "\"");
+        LOG_DEBUG(WS, PSTR("Received command \"%s\"\n"), command.c_str());
         auto path = command.substring(first_quote_position + 1, second_quote_position);
-        if (handlers_[static_cast<size_t>(Event::FLASH_ARDUINO)] != nullptr) {
-            handlers_[static_cast<size_t>(Event::FLASH_ARDUINO)](client_id, path);
-        }
+        dispatch(client_id, request_id, Event::FLASH_ARDUINO, path);
+        return;
+    }
+
+    reply_error(client_id, request_id, PSTR("ERROR: received unknown command \"") + command + "\"");
+}
+
+void
+WebSocketServer::process_binary_command(uint8_t client_id, uint8_t const* data, size_t length)
+{
+    SettingsCodec::FrameType type;
+    RequestId                request_id{NO_REQUEST_ID};
+    String                   parameters;
+    if (!SettingsCodec::decode_command(data, length, type, request_id, parameters)) {
+        LOG_WARNING(WS, PSTR("ERROR: received malformed binary command (%u bytes)\n"), length);
+        return;
+    }
+
+    Event event;
+    switch (type) {
+    case SettingsCodec::FrameType::GET_SETTINGS:
+        event = Event::GET_ARDUINO_SETTINGS;
+        break;
+    case SettingsCodec::FrameType::SET_DATETIME:
+        event = Event::ARDUINO_SET_DATETIME;
+        break;
+    case SettingsCodec::FrameType::ENABLE_ALARM:
+        event = Event::ENABLE_ARDUINO_ALARM;
+        break;
+    case SettingsCodec::FrameType::SET_ALARM_TIME:
+        event = Event::SET_ARDUINO_ALARM_TIME;
+        break;
+    case SettingsCodec::FrameType::SET_SUNRISE_DURATION:
+        event = Event::SET_ARDUINO_SUNRISE_DURATION;
+        break;
+    case SettingsCodec::FrameType::SET_BRIGHTNESS:
+        event = Event::SET_ARDUINO_BRIGHTNESS;
+        break;
+    default:
+        reply_error(client_id, request_id, F("ERROR: received unknown binary command"));
+        return;
+    }
+
+    LOG_DEBUG(WS, PSTR("Received binary command 0x%02x \"%s\"\n"), static_cast<uint8_t>(type), parameters.c_str());
+    dispatch(client_id, request_id, event, parameters);
+}
+
+void
+WebSocketServer::dispatch(uint8_t client_id, RequestId request_id, Event event, String const& parameters)
+{
+    // Admission control. Commands, which exceed rate limit of their class, are rejected before they reach Arduino
+    auto command_class = get_command_class(event);
+    if ((command_class != CommandClass::UNLIMITED) && (client_id < rate_limiters_.size()) &&
+        !rate_limiters_[client_id][static_cast<size_t>(command_class)].try_consume(millis())) {
+        LOG_WARNING(WS,
+                    PSTR("[%u] Rate limit exceeded for command class %u\n"),
+                    client_id,
+                    static_cast<uint8_t>(command_class));
+        send(client_id, F("BUSY: rate limit exceeded, try again later"), request_id);
         return;
     }
 
-    DEBUG_PRINTLN(PSTR("ERROR: received unknown command \"") + command + "\"");
-}
\ No newline at end of file
+    if (handlers_[static_cast<size_t>(event)] != nullptr) {
+        handlers_[static_cast<size_t>(event)](client_id, request_id, parameters);
+    }
+}
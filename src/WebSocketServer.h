@@ -2,9 +2,12 @@
 #define WEBSOCKETSERVER_H_
 
 #include <array>
+#include <vector>
 
 #include <WebSocketsServer.h>
 
+#include "TokenBucket.h"
+
 // Facade for communication over WebSocket. Can be used by another servers to implement their functionality
 class WebSocketServer
 {
@@ -15,6 +18,9 @@ public:
         DISCONNECTED,
         START_READING_LOGS,
         STOP_READING_LOGS,
+        GET_LOG_LEVELS,
+        SET_LOG_LEVELS,
+        SEARCH_LOGS,
         ARDUINO_COMMAND,
         FLASH_ARDUINO,
         REBOOT_ARDUINO,
@@ -27,24 +33,144 @@ public:
 
         NUM_OF_EVENTS
     };
-    using EventHandler = std::function<void(uint8_t client_id, String const& parameters)>;
+    // Optional correlation ID of request. Client can prefix any command with "#<request_id> ". In that case all
+    // replies to this command are prefixed with the same "#<request_id> ", so client can match them with requests and
+    // run several operations at once.
+    using RequestId = uint32_t;
+    static constexpr RequestId NO_REQUEST_ID{0};
+
+    using EventHandler = std::function<void(uint8_t client_id, RequestId request_id, String const& parameters)>;
+
+    // Commands are rate limited per client and per class, so one client can not flood serial link to Arduino. Command,
+    // which exceeds the limit, is rejected with "BUSY" reply
+    enum class CommandClass : uint8_t
+    {
+        LOGS = 0,
+        RAW_ARDUINO_COMMAND,
+        GET_SETTINGS,
+        SET_SETTINGS,
+        FLASH_OR_REBOOT,
+
+        NUM_OF_COMMAND_CLASSES,
+        // Commands, which only reduce load (ex. unsubscribing from logs), have no limit and are never rejected
+        UNLIMITED = NUM_OF_COMMAND_CLASSES
+    };
+
+    // Encoding of messages, selected by client on connection. Clients, connected with "/binary" URL, use compact binary
+    // frames (see SettingsCodec). All other clients use text commands and text replies.
+    enum class Encoding : uint8_t
+    {
+        TEXT = 0,
+        BINARY
+    };
+
+    // Messages with NORMAL priority, sent to the same client within coalescing window, are merged into one WebSocket
+    // frame. URGENT messages are sent immediately (after all pending messages of this client). Use them before
+    // operations, which block main loop for long time.
+    //
+    // Frame with several messages starts with batch_marker, followed by records [length:2, little-endian][message].
+    // Frame with single message is sent as is, unless the message itself starts with batch_marker.
+    enum class Priority : uint8_t
+    {
+        NORMAL = 0,
+        URGENT
+    };
+    static constexpr uint8_t batch_marker{0x1E};  // ASCII "record separator"
+
+    // Capacity of server is derived from memory budget at build time. Every client costs its WebSocket state, TCP
+    // connection and outbound buffer. Clients beyond capacity are refused.
+    static constexpr size_t  memory_budget{12 * 1024};
+    static constexpr size_t  default_max_frame_size{1400};  // Fits into one TCP segment
+    static constexpr size_t  connection_overhead{1024};     // lwIP PCB, ClientContext and receive buffers
+    static constexpr size_t  estimated_client_memory{sizeof(WSclient_t) + connection_overhead + default_max_frame_size};
+    static constexpr uint8_t max_clients{(memory_budget / estimated_client_memory < WEBSOCKETS_SERVER_CLIENT_MAX)
+                                             ? memory_budget / estimated_client_memory
+                                             : WEBSOCKETS_SERVER_CLIENT_MAX};
+    static_assert(max_clients > 0, "Memory budget of WebSocket server is too small for one client");
+
+    // Memory, used by connected client
+    struct ClientStatistics
+    {
+        size_t queued_bytes{0};       // Bytes in outbound buffer, waiting to be sent
+        size_t peak_queued_bytes{0};  // Maximal amount of bytes in outbound buffer
+        size_t buffer_capacity{0};    // Memory, allocated for outbound buffer
+        size_t sent_bytes{0};         // Total bytes sent to client
+    };
 
     WebSocketServer();
     void init();
     void loop();
     void set_handler(Event event, EventHandler handler);
 
-    // Send to all connected clients
-    void send(uint8_t client_id, String const& message);
+    // Send to client. If request_id is provided, message is sent in correlation envelope. For binary clients message is
+    // sent as status frame
+    void send(uint8_t       client_id,
+              String const& message,
+              RequestId     request_id = NO_REQUEST_ID,
+              Priority      priority   = Priority::NORMAL);
+    // Send binary frame as is
+    void send_binary(uint8_t client_id, uint8_t const* data, size_t length, Priority priority = Priority::NORMAL);
+
+    // Zero window disables coalescing
+    void set_coalescing(unsigned long window_ms, size_t max_frame_size);
+
+    Encoding encoding(uint8_t client_id) const;
+
+    uint8_t          num_of_clients() const;
+    ClientStatistics statistics(uint8_t client_id) const;
+    // Estimated memory, which client costs, including outbound buffer
+    size_t client_memory_usage(uint8_t client_id) const;
 
 private:
+    // WebSocketsServer closes connection only with normal close code. This adds closing with specific code
+    class Server : public WebSocketsServer
+    {
+    public:
+        using WebSocketsServer::WebSocketsServer;
+
+        void
+        disconnect(uint8_t client_id, uint16_t close_code)
+        {
+            if (client_id < WEBSOCKETS_SERVER_CLIENT_MAX) {
+                WebSockets::clientDisconnect(&_clients[client_id], close_code);
+            }
+        }
+    };
+
+    struct OutboundBuffer
+    {
+        std::vector<uint8_t> data;
+        uint8_t              num_of_messages{0};
+        unsigned long        first_message_time{0};
+    };
+
+    void send_frame(uint8_t client_id, uint8_t const* data, size_t length);
+    void flush(uint8_t client_id);
+    void flush_expired();
+
     void on_event(uint8_t client_id, WStype_t event_type, uint8_t* payload, size_t lenght);
-    void trigger_event(uint8_t client_id, String const& input_data, String const& command_name, Event event);
-    void process_command(uint8_t client_id, String const& command);
+    void trigger_event(uint8_t       client_id,
+                       RequestId     request_id,
+                       String const& input_data,
+                       String const& command_name,
+                       Event         event);
+    void process_command(uint8_t client_id, RequestId request_id, String const& command);
+    void process_binary_command(uint8_t client_id, uint8_t const* data, size_t length);
+    void reply_error(uint8_t client_id, RequestId request_id, String const& message);
+    void dispatch(uint8_t client_id, RequestId request_id, Event event, String const& parameters);
 
     const uint16_t                                                       port_{81};
-    WebSocketsServer                                                     web_socket_;
+    Server                                                               web_socket_;
     std::array<EventHandler, static_cast<uint8_t>(Event::NUM_OF_EVENTS)> handlers_;
+    std::array<Encoding, WEBSOCKETS_SERVER_CLIENT_MAX>                   encodings_;
+    std::array<OutboundBuffer, WEBSOCKETS_SERVER_CLIENT_MAX>             outbound_buffers_;
+    std::array<bool, WEBSOCKETS_SERVER_CLIENT_MAX>                       is_connected_;
+    std::array<ClientStatistics, WEBSOCKETS_SERVER_CLIENT_MAX>           statistics_;
+    std::array<std::array<TokenBucket, static_cast<uint8_t>(CommandClass::NUM_OF_COMMAND_CLASSES)>,
+               WEBSOCKETS_SERVER_CLIENT_MAX>
+        rate_limiters_;
+    unsigned long                                                        coalescing_window_;
+    size_t                                                               max_frame_size_;
 };
 
 
@@ -0,0 +1,28 @@
+#include "WebUiBundle.h"
+
+#if __has_include("WebUiBundle.generated.h")
+#include "WebUiBundle.generated.h"
+#else
+namespace
+{
+constexpr WebUiBundle::Asset* bundle_assets{nullptr};
+constexpr size_t              num_of_bundle_assets{0};
+}  // namespace
+#endif
+
+WebUiBundle::Asset const*
+WebUiBundle::find(String const& path)
+{
+    for (size_t i = 0; i < num_of_bundle_assets; ++i) {
+        if (strcmp_P(path.c_str(), bundle_assets[i].path) == 0) {
+            return &bundle_assets[i];
+        }
+    }
+    return nullptr;
+}
+
+size_t
+WebUiBundle::size()
+{
+    return num_of_bundle_assets;
+}
@@ -0,0 +1,26 @@
+#ifndef WEBUIBUNDLE_H_
+#define WEBUIBUNDLE_H_
+
+#include <Arduino.h>
+#include <WString.h>
+
+// Web UI pages with inlined styles and scripts, compressed with gzip and embedded into firmware by
+// tools/bundle_web_ui.py. Pages are served straight from flash memory, so UI works even if SPIFFS is corrupted.
+// If bundle is not generated, firmware is built without it and all pages are served from SPIFFS.
+class WebUiBundle
+{
+public:
+    struct Asset
+    {
+        PGM_P          path;
+        uint8_t const* data;  // gzip-compressed content in PROGMEM
+        uint32_t       size;
+        uint32_t       content_hash;  // The same hash, as FsIndex calculates for files on SPIFFS
+    };
+
+    // Returns nullptr if there is no such asset in bundle
+    static Asset const* find(String const& path);
+    static size_t       size();
+};
+
+#endif  // WEBUIBUNDLE_H_
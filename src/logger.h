@@ -1,20 +1,36 @@
 #ifndef LOGGER_H_
 #define LOGGER_H_
 
-//#define DBG_OUTPUT_PORT Serial
-#define DBG_OUTPUT_PORT Web
+#include "LogFilter.h"
+
+// Possible values of DBG_OUTPUT_PORT. Preprocessor can compare only numbers
+#define DBG_OUTPUT_SERIAL 1
+#define DBG_OUTPUT_WEB 2
+
+//#define DBG_OUTPUT_PORT DBG_OUTPUT_SERIAL
+#define DBG_OUTPUT_PORT DBG_OUTPUT_WEB
 
 // Set it if you want to log to both: web page and Serial
 // It should be always disabled if ESP is connected to Arduino. Otherwise ESP will send a lot of logs into Arduino
 constexpr bool should_log_to_serial = false; 
 
-#if DBG_OUTPUT_PORT == Serial
-#define DGB_STREAM Serial
-#endif
+// Set it if you want logs to survive reboot of ESP. Logs are saved in /logs folder in SPIFFS (see LogSpooler)
+constexpr bool should_spool_logs_to_flash = false;
 
-#if DBG_OUTPUT_PORT == Web
+// Logs with less important level are compiled out completely. Remaining logs are filtered in runtime per module by
+// LogFilter
+constexpr LogLevel log_level_threshold = LogLevel::DEBUG;
+
+#if DBG_OUTPUT_PORT == DBG_OUTPUT_SERIAL
+#define DGB_STREAM Serial
+#define DGB_PRINTF(level, module, ...) Serial.printf_P(__VA_ARGS__)
+#elif DBG_OUTPUT_PORT == DBG_OUTPUT_WEB
 #include "BufferedLogger.h"
 #define DGB_STREAM BufferedLogger::instance()
+// Arguments are stored in binary form and are formatted only when somebody reads logs
+#define DGB_PRINTF(level, module, ...) BufferedLogger::instance().printf_deferred(level, module, __VA_ARGS__)
+#else
+#error "Unknown DBG_OUTPUT_PORT"
 #endif
 
 #define DEBUG_PRINT(msg)          \
@@ -29,11 +45,22 @@ constexpr bool should_log_to_serial = false;
         if (should_log_to_serial) \
             Serial.println(msg);  \
     }
-#define DEBUG_PRINTF(...)                 \
-    {                                     \
-        DGB_STREAM.printf_P(__VA_ARGS__); \
-        if (should_log_to_serial)         \
-            Serial.printf_P(__VA_ARGS__); \
+#define DEBUG_PRINTF(...) LOG_MESSAGE(LogLevel::INFO, LogModule::SYSTEM, __VA_ARGS__)
+
+// Usage: LOG_INFO(WEB, PSTR("format"), arguments...)
+#define LOG_ERROR(module, ...) LOG_MESSAGE(LogLevel::ERROR, LogModule::module, __VA_ARGS__)
+#define LOG_WARNING(module, ...) LOG_MESSAGE(LogLevel::WARNING, LogModule::module, __VA_ARGS__)
+#define LOG_INFO(module, ...) LOG_MESSAGE(LogLevel::INFO, LogModule::module, __VA_ARGS__)
+#define LOG_DEBUG(module, ...) LOG_MESSAGE(LogLevel::DEBUG, LogModule::module, __VA_ARGS__)
+#define LOG_TRACE(module, ...) LOG_MESSAGE(LogLevel::TRACE, LogModule::module, __VA_ARGS__)
+
+#define LOG_MESSAGE(level, module, ...)                                                            \
+    {                                                                                              \
+        if ((level <= log_level_threshold) && LogFilter::instance().is_enabled(module, level)) { \
+            DGB_PRINTF(level, module, __VA_ARGS__);                                                \
+            if (should_log_to_serial)                                                              \
+                Serial.printf_P(__VA_ARGS__);                                                      \
+        }                                                                                          \
     }
 
-#endif  // LOGGER_H_
\ No newline at end of file
+#endif  // LOGGER_H_
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Build web UI bundle, which is embedded into firmware and served from flash memory, without SPIFFS.
+
+Every page is taken from data/ together with its local styles and scripts, which are inlined into the page. Page is
+minified, compressed with gzip and written as PROGMEM byte array into src/WebUiBundle.generated.h together with its
+size and content hash, which is used as ETag. Firmware is built with bundle if this file exists, so bundle is optional:
+  tools/bundle_web_ui.py            - build bundle and build firmware with it
+  rm src/WebUiBundle.generated.h    - build firmware without bundle
+
+File with the same path on SPIFFS overrides bundled page, so bundled pages don't need to be uploaded to SPIFFS. Images
+are not bundled. Pages are served without them if SPIFFS is corrupted.
+"""
+
+import argparse
+import gzip
+import io
+import os
+import re
+
+BUNDLED_PAGES = ('index.htm', 'settings.htm', 'log.htm', 'help.htm')
+FNV_OFFSET_BASIS = 2166136261
+FNV_PRIME = 16777619
+
+STYLE_RE = re.compile(r'<link\s+rel="stylesheet"\s+href="([^":/]+)"\s*>')
+SCRIPT_RE = re.compile(r'<script\s+src="([^":/]+)"\s*>\s*</script>')
+HTML_COMMENT_RE = re.compile(r'<!--.*?-->', re.DOTALL)
+CSS_COMMENT_RE = re.compile(r'/\*.*?\*/', re.DOTALL)
+
+
+def minify(text):
+    """Remove indentation, empty lines and whole-line "//" comments. Line breaks are kept, as scripts rely on them."""
+    lines = (line.strip() for line in text.splitlines())
+    return '\n'.join(line for line in lines if line and not line.startswith('//'))
+
+
+def read_text(data_dir, name):
+    with open(os.path.join(data_dir, name), encoding='utf-8') as text_file:
+        return text_file.read()
+
+
+def inline_page(data_dir, name):
+    page = HTML_COMMENT_RE.sub('', read_text(data_dir, name))
+    page = STYLE_RE.sub(lambda match: '<style>' + CSS_COMMENT_RE.sub('', read_text(data_dir, match.group(1))) +
+                        '</style>', page)
+    page = SCRIPT_RE.sub(lambda match: '<script>' + read_text(data_dir, match.group(1)) + '</script>', page)
+    return minify(page)
+
+
+def gzip_compress(data):
+    output = io.BytesIO()
+    with gzip.GzipFile(filename='', mode='wb', compresslevel=9, fileobj=output, mtime=0) as gz_file:
+        gz_file.write(data)
+    return output.getvalue()
+
+
+def fnv1a(data):
+    """The same hash, as FsIndex calculates for content of files on SPIFFS"""
+    value = FNV_OFFSET_BASIS
+    for byte in data:
+        value = ((value ^ byte) * FNV_PRIME) & 0xFFFFFFFF
+    return value if value != 0 else 1
+
+
+def identifier(name):
+    return re.sub(r'\W', '_', name)
+
+
+def write_header(path, assets):
+    lines = ['// Generated by tools/bundle_web_ui.py. Do not edit',
+             '',
+             '#ifndef WEBUIBUNDLE_GENERATED_H_',
+             '#define WEBUIBUNDLE_GENERATED_H_',
+             '',
+             'namespace',
+             '{']
+    for name, data in assets:
+        lines.append('constexpr char {}_path[] PROGMEM = "/{}";'.format(identifier(name), name))
+        lines.append('constexpr uint8_t {}_data[] PROGMEM = {{'.format(identifier(name)))
+        for offset in range(0, len(data), 16):
+            lines.append('    ' + ', '.join('0x{:02x}'.format(byte) for byte in data[offset:offset + 16]) + ',')
+        lines.append('};')
+    lines.append('')
+    lines.append('constexpr WebUiBundle::Asset bundle_assets[]{')
+    for name, data in assets:
+        lines.append('    {{{0}_path, {0}_data, sizeof({0}_data), 0x{1:08x}u}},'.format(identifier(name), fnv1a(data)))
+    lines.append('};')
+    lines.append('constexpr size_t num_of_bundle_assets{sizeof(bundle_assets) / sizeof(bundle_assets[0])};')
+    lines.append('}  // namespace')
+    lines.append('')
+    lines.append('#endif  // WEBUIBUNDLE_GENERATED_H_')
+    with open(path, 'w', encoding='utf-8') as header_file:
+        header_file.write('\n'.join(lines) + '\n')
+
+
+def main():
+    root_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..')
+    parser = argparse.ArgumentParser(description='Embed web UI pages into firmware')
+    parser.add_argument('--data-dir', default=os.path.join(root_dir, 'data'))
+    parser.add_argument('--output', default=os.path.join(root_dir, 'src', 'WebUiBundle.generated.h'))
+    args = parser.parse_args()
+
+    assets = []
+    for name in BUNDLED_PAGES:
+        page = inline_page(args.data_dir, name).encode('utf-8')
+        data = gzip_compress(page)
+        print('{}: {} -> {} bytes'.format(name, len(page), len(data)))
+        assets.append((name, data))
+    write_header(args.output, assets)
+    print('Bundle is written to {}'.format(os.path.relpath(args.output)))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Produce precompressed variants of web assets in data/ before uploading it to SPIFFS.
+
+For every page, script, style and icon "<name>" the script writes "<name>.gz" and, if "brotli" Python module is
+installed and --brotli is passed, "<name>.br". Web server picks the best variant, accepted by browser. Variant is not
+written if it doesn't make file noticeably smaller. Output is deterministic (no timestamps), so ETag of unchanged file
+stays the same after re-upload.
+
+Usage: tools/compress_data.py [--brotli] [--remove-originals] [data_dir]
+  --remove-originals  keep only compressed variants to save flash. Clients, which don't accept gzip, will get gzip
+                      anyway, as it was with edit.htm.gz
+"""
+
+import argparse
+import gzip
+import io
+import os
+import sys
+
+COMPRESSIBLE_EXTENSIONS = ('.htm', '.html', '.css', '.js', '.json', '.svg', '.ico', '.txt')
+# Variant is kept only if it is smaller than this part of original file
+MIN_COMPRESSION_RATIO = 0.9
+
+
+def gzip_compress(data):
+    output = io.BytesIO()
+    with gzip.GzipFile(filename='', mode='wb', compresslevel=9, fileobj=output, mtime=0) as gz_file:
+        gz_file.write(data)
+    return output.getvalue()
+
+
+def write_variant(path, data, original_size):
+    if len(data) > original_size * MIN_COMPRESSION_RATIO:
+        if os.path.exists(path):
+            os.remove(path)
+        return False
+    with open(path, 'wb') as variant_file:
+        variant_file.write(data)
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Precompress web assets for SPIFFS')
+    parser.add_argument('data_dir', nargs='?', default=os.path.join(os.path.dirname(__file__), '..', 'data'))
+    parser.add_argument('--brotli', action='store_true', help='also produce brotli (.br) variants')
+    parser.add_argument('--remove-originals', action='store_true', help='remove files, which have gzip variant')
+    args = parser.parse_args()
+
+    brotli = None
+    if args.brotli:
+        try:
+            import brotli
+        except ImportError:
+            print('"brotli" module is not installed, skipping .br variants', file=sys.stderr)
+
+    total_original_size = 0
+    total_compressed_size = 0
+    for name in sorted(os.listdir(args.data_dir)):
+        path = os.path.join(args.data_dir, name)
+        if not os.path.isfile(path) or not name.endswith(COMPRESSIBLE_EXTENSIONS):
+            continue
+
+        with open(path, 'rb') as original_file:
+            data = original_file.read()
+        smallest_size = len(data)
+
+        gz_data = gzip_compress(data)
+        has_gz_variant = write_variant(path + '.gz', gz_data, len(data))
+        if has_gz_variant:
+            smallest_size = len(gz_data)
+        if brotli is not None:
+            br_data = brotli.compress(data, quality=11)
+            if write_variant(path + '.br', br_data, len(data)):
+                smallest_size = min(smallest_size, len(br_data))
+
+        print('{}: {} -> {} bytes'.format(name, len(data), smallest_size))
+        total_original_size += len(data)
+        total_compressed_size += smallest_size
+        if args.remove_originals and has_gz_variant:
+            os.remove(path)
+
+    print('Total: {} -> {} bytes'.format(total_original_size, total_compressed_size))
+
+
+if __name__ == '__main__':
+    main()
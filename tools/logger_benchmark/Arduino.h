@@ -0,0 +1,10 @@
+// Minimal replacement of Arduino.h, enough to build RingBuffer on host
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#endif  // ARDUINO_H_
@@ -0,0 +1,96 @@
+// Host micro-benchmark of BufferedLogger storage: bytes logged per second by the old String-based log, which was
+// trimmed after every write, and by RingBuffer, which replaced it.
+//
+// Build and run from the root of repository:
+//   g++ -O2 -std=gnu++17 -Itools/logger_benchmark -Isrc -o /tmp/logger_benchmark
+//       tools/logger_benchmark/logger_benchmark.cpp src/RingBuffer.cpp
+//   /tmp/logger_benchmark
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "RingBuffer.h"
+
+namespace
+{
+constexpr size_t buf_size{2 * 1024};  // Default size of BufferedLogger
+constexpr size_t total_bytes{64 * 1024 * 1024};
+char const       line[] = "[WS] [1] Connected from 192.168.1.10 url: /, free heap 23456\n";
+
+// Storage of BufferedLogger before RingBuffer: append to string, then cut the oldest bytes with substring(), which
+// allocates new string and copies the whole buffer
+class StringLog
+{
+public:
+    StringLog()
+    {
+        log_.reserve(buf_size);
+    }
+
+    void
+    write(uint8_t const* data, size_t size)
+    {
+        log_.append(reinterpret_cast<char const*>(data), size);
+        if (log_.length() > buf_size) {
+            log_ = log_.substr(log_.length() - buf_size);
+        }
+    }
+
+private:
+    std::string log_;
+};
+
+class RingLog
+{
+public:
+    void
+    write(uint8_t const* data, size_t size)
+    {
+        log_.write(data, size);
+    }
+
+private:
+    RingBuffer log_{buf_size};
+};
+
+// Writes "total_bytes" in chunks of "chunk_size" bytes and returns bytes per second
+template <typename Log>
+double
+measure(size_t chunk_size)
+{
+    Log          log;
+    auto const*  data = reinterpret_cast<uint8_t const*>(line);
+    size_t const line_size{sizeof(line) - 1};
+    size_t       position{0};
+    auto         start = std::chrono::steady_clock::now();
+    for (size_t written = 0; written < total_bytes; written += chunk_size) {
+        // Chunks never cross end of line, so per-byte writes are as the ones of Print::write(uint8_t)
+        size_t size = std::min(chunk_size, line_size - position);
+        log.write(data + position, size);
+        position = (position + size) % line_size;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return total_bytes / elapsed.count();
+}
+
+void
+report(char const* name, size_t chunk_size)
+{
+    double before = measure<StringLog>(chunk_size);
+    double after  = measure<RingLog>(chunk_size);
+    printf("%-10s string: %10.1f MB/s, ring buffer: %10.1f MB/s, speedup x%.1f\n",
+           name,
+           before / 1e6,
+           after / 1e6,
+           after / before);
+}
+}  // namespace
+
+int
+main()
+{
+    report("per byte", 1);
+    report("per line", sizeof(line) - 1);
+    return 0;
+}
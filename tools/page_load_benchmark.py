@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Benchmark of concurrent page loads from web server of SAD-Lamp.
+
+N simulated browsers load a page together with its resources (scripts, styles, images, referenced by the page), as
+a browser does with empty cache, and repeat it for given duration. Every request uses its own connection: web server
+of ESP (ESPAsyncWebServer) doesn't support keep-alive and closes connection after every response, so connection setup
+is part of measured latency. Reports page load time (all resources of page are loaded), request latency and throughput,
+so results of the same run can be compared before and after change of web server.
+
+Usage: tools/page_load_benchmark.py [--clients N] [--duration S] [--page PATH] host
+"""
+
+import argparse
+import http.client
+import re
+import statistics
+import threading
+import time
+
+# Resources, which browser loads together with page: scripts, images and styles. Links to other pages are skipped
+RESOURCE_RE = re.compile(r'<(?:script|img)\b[^>]*\ssrc\s*=\s*["\']([^"\':?#]+)["\']|'
+                         r'<link\b[^>]*\shref\s*=\s*["\']([^"\':?#]+)["\']', re.IGNORECASE)
+TIMEOUT = 30
+
+
+class Report:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.page_times = []
+        self.request_times = []
+        self.bytes = 0
+        self.errors = 0
+
+    def add_request(self, elapsed, size):
+        with self.lock:
+            self.request_times.append(elapsed)
+            self.bytes += size
+
+    def add_error(self):
+        with self.lock:
+            self.errors += 1
+
+    def add_page(self, elapsed):
+        with self.lock:
+            self.page_times.append(elapsed)
+
+    def print(self, clients, duration):
+        print('{} clients, {:.1f} s'.format(clients, duration))
+        print('Pages loaded: {} ({:.2f} pages/s), failed requests: {}'.format(
+            len(self.page_times), len(self.page_times) / duration, self.errors))
+        for name, times in (('Page load', self.page_times), ('Request', self.request_times)):
+            if times:
+                times.sort()
+                print('{} time, ms: median {:.0f}, p95 {:.0f}, max {:.0f}'.format(
+                    name, statistics.median(times) * 1000, times[int(len(times) * 0.95)] * 1000, times[-1] * 1000))
+        print('Requests: {:.1f} per second, {:.1f} KB/s'.format(
+            len(self.request_times) / duration, self.bytes / 1024 / duration))
+
+
+def get(host, path, report):
+    """Returns body of response or None on error."""
+    started = time.monotonic()
+    connection = http.client.HTTPConnection(host, timeout=TIMEOUT)
+    try:
+        # Ask for compressed variants, as browser does
+        connection.request('GET', path, headers={'Accept-Encoding': 'gzip, br', 'Connection': 'close'})
+        response = connection.getresponse()
+        body = response.read()
+        if response.status != 200:
+            raise http.client.HTTPException('HTTP {}'.format(response.status))
+    except (OSError, http.client.HTTPException) as error:
+        print('{}: {}'.format(path, error))
+        report.add_error()
+        return None
+    finally:
+        connection.close()
+    report.add_request(time.monotonic() - started, len(body))
+    return body
+
+
+def resources_of(page, body):
+    base = page.rsplit('/', 1)[0] + '/'
+    resources = []
+    for match in RESOURCE_RE.finditer(body.decode(errors='replace')):
+        resource = match.group(1) or match.group(2)
+        if not resource.startswith('/'):
+            resource = base + resource
+        if resource not in resources and resource != page:
+            resources.append(resource)
+    return resources
+
+
+def browser(host, page, deadline, report):
+    while time.monotonic() < deadline:
+        started = time.monotonic()
+        body = get(host, page, report)
+        if body is None:
+            continue
+        # Browser loads resources of page in parallel, over several connections
+        results = []
+        loaders = [threading.Thread(target=lambda path=path: results.append(get(host, path, report)))
+                   for path in resources_of(page, body)]
+        for loader in loaders:
+            loader.start()
+        for loader in loaders:
+            loader.join()
+        if all(result is not None for result in results):
+            report.add_page(time.monotonic() - started)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark of concurrent page loads from SAD-Lamp')
+    parser.add_argument('host', help='IP address or host name of SAD-Lamp')
+    parser.add_argument('--clients', type=int, default=4, help='number of simulated browsers')
+    parser.add_argument('--duration', type=float, default=30, help='duration of test, s')
+    parser.add_argument('--page', default='/index.htm', help='page to load')
+    args = parser.parse_args()
+
+    report = Report()
+    started = time.monotonic()
+    deadline = started + args.duration
+    browsers = [threading.Thread(target=browser, args=(args.host, args.page, deadline, report))
+                for _ in range(args.clients)]
+    for thread in browsers:
+        thread.start()
+    for thread in browsers:
+        thread.join()
+    report.print(args.clients, time.monotonic() - started)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Update files on SPIFFS of SAD-Lamp from data/ directory over HTTP, uploading only changed files.
+
+The script sends manifest with FNV-1a hash of every file to ESP. ESP replies with list of files, which differ from
+manifest. Only they are uploaded, and then ESP replaces all of them at once. If upload fails, files on ESP stay
+untouched. Files on ESP, which are not in data/, are kept.
+
+Usage: tools/update_data.py [--dry-run] host [data_dir]
+"""
+
+import argparse
+import json
+import os
+import sys
+import urllib.error
+import urllib.parse
+import urllib.request
+
+FNV_OFFSET_BASIS = 2166136261
+FNV_PRIME = 16777619
+
+
+def content_hash(data):
+    """Same hash as FsIndex::content_hash() on ESP."""
+    result = FNV_OFFSET_BASIS
+    for byte in data:
+        result = ((result ^ byte) * FNV_PRIME) & 0xFFFFFFFF
+    # 0 means "not calculated" on ESP
+    return result if result != 0 else 1
+
+
+def request(url, method, data=b''):
+    http_request = urllib.request.Request(url, data=data, method=method,
+                                          headers={'Content-Type': 'application/octet-stream'})
+    with urllib.request.urlopen(http_request) as response:
+        return response.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Update files on SPIFFS of SAD-Lamp')
+    parser.add_argument('host', help='IP address or host name of SAD-Lamp')
+    parser.add_argument('data_dir', nargs='?', default=os.path.join(os.path.dirname(__file__), '..', 'data'))
+    parser.add_argument('--dry-run', action='store_true', help='only print files, which would be uploaded')
+    args = parser.parse_args()
+
+    files = {}
+    for name in sorted(os.listdir(args.data_dir)):
+        path = os.path.join(args.data_dir, name)
+        if os.path.isfile(path):
+            with open(path, 'rb') as data_file:
+                files['/' + name] = data_file.read()
+    manifest = ''.join('{:08x} {}\n'.format(content_hash(data), path) for path, data in files.items())
+
+    base_url = 'http://{}/fs_update'.format(args.host)
+    try:
+        changed_files = json.loads(request(base_url, 'POST', manifest.encode()))['files']
+        print('{} of {} files differ'.format(len(changed_files), len(files)))
+        if args.dry_run:
+            print('\n'.join(changed_files))
+            request(base_url, 'DELETE')
+            return
+
+        for path in changed_files:
+            print('{}: {} bytes'.format(path, len(files[path])))
+            request('{}/file?path={}'.format(base_url, urllib.parse.quote(path)), 'POST', files[path])
+        result = json.loads(request(base_url + '/commit', 'POST'))
+        print('{} files are updated'.format(result['updated']))
+    except urllib.error.HTTPError as error:
+        print('ERROR: {} {}'.format(error.code, error.read().decode(errors='replace').strip()), file=sys.stderr)
+        try:
+            request(base_url, 'DELETE')
+        except urllib.error.URLError:
+            pass
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Benchmark of file upload throughput of SAD-Lamp across file sizes.
+
+The script uploads files of several sizes to "/edit", as web file editor does, and measures throughput on host side.
+At the same time it reads logs of "fs" module over WebSocket and picks the line, which ESP logs at the end of every
+upload ("Upload: END, <path>, <size> bytes in <ms> ms (<KB/s> KB/s)"), so time of writing to SPIFFS is reported
+separately from network time. Uploaded files are deleted afterwards.
+
+Usage: tools/upload_benchmark.py [--sizes 1K,16K,...] [--repeats N] host
+"""
+
+import argparse
+import asyncio
+import os
+import re
+import statistics
+import sys
+import time
+import urllib.parse
+import urllib.request
+
+from ws_load_test import WebSocket
+
+UPLOAD_END_RE = re.compile(rb'Upload: END, (\S+), (\d+) bytes in (\d+) ms')
+LOG_WAIT_TIME = 2  # How long to wait for log line of upload, s
+
+
+def parse_size(text):
+    multipliers = {'K': 1024, 'M': 1024 * 1024}
+    if text[-1].upper() in multipliers:
+        return int(text[:-1]) * multipliers[text[-1].upper()]
+    return int(text)
+
+
+def upload(host, path, data):
+    """Returns upload time, s."""
+    boundary = 'upload-benchmark-{}'.format(os.urandom(8).hex())
+    body = ('--{}\r\nContent-Disposition: form-data; name="data"; filename="{}"\r\n'
+            'Content-Type: application/octet-stream\r\n\r\n').format(boundary, path).encode()
+    body += data + '\r\n--{}--\r\n'.format(boundary).encode()
+    request = urllib.request.Request('http://{}/edit'.format(host), data=body, method='POST',
+                                     headers={'Content-Type': 'multipart/form-data; boundary=' + boundary})
+    started = time.monotonic()
+    with urllib.request.urlopen(request) as response:
+        response.read()
+    return time.monotonic() - started
+
+
+def delete(host, path):
+    request = urllib.request.Request(
+        'http://{}/edit?{}'.format(host, urllib.parse.urlencode({'path': path})), method='DELETE')
+    with urllib.request.urlopen(request) as response:
+        response.read()
+
+
+async def read_upload_logs(web_socket, device_times):
+    """Collects write time of every upload from logs of ESP: path -> list of times, s."""
+    while True:
+        messages = await web_socket.receive()
+        if messages is None:
+            return
+        for message in messages:
+            for path, _, elapsed_ms in UPLOAD_END_RE.findall(message):
+                device_times.setdefault(path.decode(), []).append(int(elapsed_ms) / 1000)
+
+
+def kb_per_s(size, seconds):
+    return size / 1024 / max(seconds, 0.001)
+
+
+async def run(args):
+    sizes = [parse_size(size) for size in args.sizes.split(',')]
+    loop = asyncio.get_event_loop()
+    device_times = {}
+    web_socket = await WebSocket.connect(args.host)
+    web_socket.send_text('start_reading_logs modules=fs text=Upload: END')
+    log_reader = asyncio.ensure_future(read_upload_logs(web_socket, device_times))
+
+    print('{:>10} {:>16} {:>16} {:>12}'.format('size', 'upload, KB/s', 'on ESP, KB/s', 'on ESP, ms'))
+    for size in sizes:
+        path = '/upload_benchmark_{}.bin'.format(size)
+        upload_times = []
+        for _ in range(args.repeats):
+            try:
+                upload_times.append(await loop.run_in_executor(None, upload, args.host, path, os.urandom(size)))
+            except OSError as error:
+                print('{}: upload failed: {}'.format(path, error))
+        await asyncio.sleep(LOG_WAIT_TIME)
+        try:
+            await loop.run_in_executor(None, delete, args.host, path)
+        except OSError as error:
+            print('{}: delete failed: {}'.format(path, error))
+
+        if not upload_times:
+            continue
+        upload_time = statistics.median(upload_times)
+        times = device_times.get(path)
+        device_time = statistics.median(times) if times else None
+        print('{:>10} {:>16.1f} {:>16} {:>12}'.format(
+            size, kb_per_s(size, upload_time),
+            '{:.1f}'.format(kb_per_s(size, device_time)) if device_time is not None else 'no log',
+            '{:.0f}'.format(device_time * 1000) if device_time is not None else '-'))
+
+    log_reader.cancel()
+    web_socket.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark of file upload throughput of SAD-Lamp')
+    parser.add_argument('host', help='IP address or host name of SAD-Lamp')
+    parser.add_argument('--sizes', default='1K,4K,16K,64K,256K', help='comma-separated sizes of files, bytes, K or M')
+    parser.add_argument('--repeats', type=int, default=3, help='uploads of every size, median is reported')
+    args = parser.parse_args()
+
+    try:
+        asyncio.get_event_loop().run_until_complete(run(args))
+    except (OSError, ConnectionError) as error:
+        sys.exit('Can not connect to {}: {}'.format(args.host, error))
+
+
+if __name__ == '__main__':
+    main()
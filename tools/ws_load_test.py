@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""Load test of WebSocket server of SAD-Lamp.
+
+The script connects N simulated clients to port 81. Part of them stream logs ("start_reading_logs"), the rest send
+commands in correlation envelope ("#<request_id> <command>") and measure latency of replies. Commands are mixed:
+"get_log_levels" is handled by ESP itself, "get_arduino_settings" costs round trips to Arduino over serial link.
+Clients, refused by ESP at capacity, are counted by close code 1013.
+
+Free heap of ESP is sampled by short probe connections: ESP logs free heap on every connection, and log streaming
+clients pick these lines from the log.
+
+Usage: tools/ws_load_test.py [--clients N] [--log-clients N] [--duration S] [--interval MS] host
+"""
+
+import argparse
+import asyncio
+import base64
+import os
+import re
+import statistics
+import struct
+import sys
+import time
+
+PORT = 81
+BATCH_MARKER = 0x1E  # Frame with several messages, see WebSocketServer::Priority
+CLOSE_TRY_AGAIN_LATER = 1013
+COMMANDS = ('get_log_levels', 'get_arduino_settings')
+HEAP_RE = re.compile(rb'free heap (\d+)')
+
+
+class WebSocket:
+    """Minimal RFC 6455 client: enough to talk to the lamp, no extensions."""
+
+    def __init__(self, reader, writer):
+        self.reader = reader
+        self.writer = writer
+        self.close_code = None
+
+    @classmethod
+    async def connect(cls, host, path='/'):
+        reader, writer = await asyncio.open_connection(host, PORT)
+        key = base64.b64encode(os.urandom(16)).decode()
+        writer.write(('GET {} HTTP/1.1\r\nHost: {}:{}\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n'
+                      'Sec-WebSocket-Key: {}\r\nSec-WebSocket-Version: 13\r\n\r\n').format(path, host, PORT, key)
+                     .encode())
+        response = await reader.readuntil(b'\r\n\r\n')
+        if b' 101 ' not in response.split(b'\r\n', 1)[0]:
+            writer.close()
+            raise ConnectionError('handshake failed: ' + response.split(b'\r\n', 1)[0].decode(errors='replace'))
+        return cls(reader, writer)
+
+    def send_text(self, text):
+        payload = text.encode()
+        header = bytes([0x81])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack('>H', len(payload))
+        mask = os.urandom(4)
+        self.writer.write(header + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(payload)))
+
+    async def receive(self):
+        """Returns list of messages of the next data frame, or None when connection is closed."""
+        while True:
+            try:
+                first, second = await self.reader.readexactly(2)
+                length = second & 0x7F
+                if length == 126:
+                    length = struct.unpack('>H', await self.reader.readexactly(2))[0]
+                elif length == 127:
+                    length = struct.unpack('>Q', await self.reader.readexactly(8))[0]
+                payload = await self.reader.readexactly(length)
+            except (asyncio.IncompleteReadError, ConnectionError):
+                return None
+
+            opcode = first & 0x0F
+            if opcode == 0x8:
+                self.close_code = struct.unpack('>H', payload[:2])[0] if len(payload) >= 2 else None
+                return None
+            if opcode in (0x1, 0x2):
+                return split_batch(payload)
+
+    def close(self):
+        self.writer.close()
+
+
+def split_batch(payload):
+    if not payload or payload[0] != BATCH_MARKER:
+        return [payload]
+    messages = []
+    position = 1
+    while position + 2 <= len(payload):
+        length = struct.unpack('<H', payload[position:position + 2])[0]
+        messages.append(payload[position + 2:position + 2 + length])
+        position += 2 + length
+    return messages
+
+
+class Report:
+    def __init__(self):
+        self.latencies = {command: [] for command in COMMANDS}
+        self.busy = 0
+        self.timeouts = 0
+        self.log_messages = 0
+        self.log_bytes = 0
+        self.heap = []
+        self.refused = 0
+        self.failed = 0
+
+    def print(self, duration):
+        print('Refused clients (close code {}): {}, failed connections: {}'.format(
+            CLOSE_TRY_AGAIN_LATER, self.refused, self.failed))
+        for command, latencies in self.latencies.items():
+            if latencies:
+                latencies.sort()
+                print('{}: {} replies, latency ms: median {:.1f}, p95 {:.1f}, max {:.1f}'.format(
+                    command, len(latencies), statistics.median(latencies),
+                    latencies[int(len(latencies) * 0.95)], latencies[-1]))
+            else:
+                print('{}: no replies'.format(command))
+        print('Rejected as BUSY: {}, not replied: {}'.format(self.busy, self.timeouts))
+        print('Log streaming: {} messages, {:.0f} bytes/s'.format(self.log_messages, self.log_bytes / duration))
+        if self.heap:
+            print('Free heap, bytes: min {}, max {}, last {}'.format(min(self.heap), max(self.heap), self.heap[-1]))
+        else:
+            print('Free heap: no samples (no log streaming clients or log level of "ws" is below info)')
+
+
+async def log_client(host, deadline, report):
+    try:
+        web_socket = await WebSocket.connect(host)
+    except (OSError, ConnectionError):
+        report.failed += 1
+        return
+    web_socket.send_text('start_reading_logs')
+    while time.monotonic() < deadline:
+        try:
+            messages = await asyncio.wait_for(web_socket.receive(), deadline - time.monotonic())
+        except asyncio.TimeoutError:
+            break
+        if messages is None:
+            if web_socket.close_code == CLOSE_TRY_AGAIN_LATER:
+                report.refused += 1
+            return
+        for message in messages:
+            report.log_messages += 1
+            report.log_bytes += len(message)
+            report.heap.extend(int(heap) for heap in HEAP_RE.findall(message))
+    web_socket.close()
+
+
+async def command_client(host, deadline, interval, report, client_index):
+    try:
+        web_socket = await WebSocket.connect(host)
+    except (OSError, ConnectionError):
+        report.failed += 1
+        return
+
+    pending = {}  # Request ID -> (command, time of sending)
+
+    async def receive_replies():
+        while True:
+            messages = await web_socket.receive()
+            if messages is None:
+                return
+            now = time.monotonic()
+            for message in messages:
+                match = re.match(rb'#(\d+) ', message)
+                if not match or int(match.group(1)) not in pending:
+                    continue
+                command, sent_time = pending.pop(int(match.group(1)))
+                if message[match.end():].startswith(b'BUSY'):
+                    report.busy += 1
+                else:
+                    report.latencies[command].append((now - sent_time) * 1000)
+
+    receiver = asyncio.ensure_future(receive_replies())
+    request_id = 1
+    while (time.monotonic() < deadline) and not receiver.done():
+        command = COMMANDS[(request_id + client_index) % len(COMMANDS)]
+        pending[request_id] = (command, time.monotonic())
+        web_socket.send_text('#{} {}'.format(request_id, command))
+        request_id += 1
+        await asyncio.sleep(interval)
+
+    if receiver.done() and web_socket.close_code == CLOSE_TRY_AGAIN_LATER:
+        report.refused += 1
+        web_socket.close()
+        return
+    # Give the last requests a chance to be replied
+    await asyncio.sleep(1)
+    receiver.cancel()
+    report.timeouts += len(pending)
+    web_socket.close()
+
+
+async def heap_probe(host, deadline, period, report):
+    while time.monotonic() + period < deadline:
+        await asyncio.sleep(period)
+        try:
+            web_socket = await WebSocket.connect(host)
+        except (OSError, ConnectionError):
+            report.failed += 1
+            continue
+        await asyncio.sleep(0.2)
+        web_socket.close()
+
+
+async def run(args):
+    report = Report()
+    deadline = time.monotonic() + args.duration
+    tasks = [log_client(args.host, deadline, report) for _ in range(args.log_clients)]
+    tasks += [command_client(args.host, deadline, args.interval / 1000, report, i)
+              for i in range(args.clients - args.log_clients)]
+    tasks.append(heap_probe(args.host, deadline, args.heap_probe_period, report))
+    started = time.monotonic()
+    await asyncio.gather(*tasks)
+    report.print(time.monotonic() - started)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load test of WebSocket server of SAD-Lamp')
+    parser.add_argument('host', help='IP address or host name of SAD-Lamp')
+    parser.add_argument('--clients', type=int, default=4, help='number of simulated clients')
+    parser.add_argument('--log-clients', type=int, default=1, help='how many of clients stream logs')
+    parser.add_argument('--duration', type=float, default=30, help='duration of test, s')
+    parser.add_argument('--interval', type=float, default=500, help='interval between commands of one client, ms')
+    parser.add_argument('--heap-probe-period', type=float, default=5, help='period of heap probe connections, s')
+    args = parser.parse_args()
+    if args.log_clients > args.clients:
+        parser.error('--log-clients should not exceed --clients')
+
+    asyncio.get_event_loop().run_until_complete(run(args))
+
+
+if __name__ == '__main__':
+    main()